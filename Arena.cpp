@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Arena.h"
+
+#include <algorithm>
+
+namespace android {
+namespace vintf {
+
+static constexpr size_t kFirstBlockSize = 4096;
+static constexpr size_t kMaxBlockSize = 64 * 1024;
+
+static thread_local ArenaScope* gCurrentScope = nullptr;
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    if (mSealed) {
+        return nullptr;
+    }
+    // Blocks from new[] are aligned for any type, so offsets are aligned relative to the
+    // start of the block.
+    size_t offset = (mUsed + alignment - 1) & ~(alignment - 1);
+    if (mBlocks.empty() || offset + size > mBlocks.back().size) {
+        size_t blockSize = mBlocks.empty() ? kFirstBlockSize
+                                           : std::min(mBlocks.back().size * 2, kMaxBlockSize);
+        blockSize = std::max(blockSize, size);
+        mBlocks.push_back({std::unique_ptr<char[]>(new char[blockSize]), blockSize});
+        offset = 0;
+    }
+    mUsed = offset + size;
+    return mBlocks.back().data.get() + offset;
+}
+
+bool Arena::deallocate(void* p, size_t size) {
+    char* c = static_cast<char*>(p);
+    if (!mSealed) {
+        // Everything was allocated from the arena so far. Give back the memory if it is
+        // at the end of the last block, e.g. a set node that was not inserted because
+        // it was a duplicate.
+        char* last = mBlocks.back().data.get();
+        if (c + size == last + mUsed) {
+            mUsed = c - last;
+        }
+        return true;
+    }
+    return std::any_of(mBlocks.begin(), mBlocks.end(), [c](const Block& block) {
+        return c >= block.data.get() && c < block.data.get() + block.size;
+    });
+}
+
+ArenaScope::ArenaScope() : mArena(std::make_shared<Arena>()), mPrevious(gCurrentScope) {
+    gCurrentScope = this;
+}
+
+ArenaScope::~ArenaScope() {
+    mArena->seal();
+    gCurrentScope = mPrevious;
+}
+
+// static
+std::shared_ptr<Arena> ArenaScope::current() {
+    return gCurrentScope != nullptr ? gCurrentScope->mArena : nullptr;
+}
+
+}  // namespace vintf
+}  // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompatibilityChecker.h"
+
+#include "utils.h"
+
+namespace android {
+namespace vintf {
+
+constexpr size_t CompatibilityChecker::kDefaultCapacity;
+
+CompatibilityChecker::CompatibilityChecker(size_t capacity) : mCapacity(capacity) {}
+
+int32_t CompatibilityChecker::checkCompatibility(const std::vector<std::string>& xmls,
+                                                 std::string* error,
+                                                 DisabledChecks disabledChecks) {
+    return details::checkCompatibility(xmls, false /* mount */, *details::gPartitionMounter,
+                                       error, disabledChecks, this);
+}
+
+void CompatibilityChecker::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResults.clear();
+    mIndex.clear();
+}
+
+bool CompatibilityChecker::check(details::UpdateCheck check,
+                                 const std::shared_ptr<const void>& first,
+                                 const std::shared_ptr<const void>& second,
+                                 DisabledChecks disabledChecks, std::string* error,
+                                 const std::function<bool(std::string*)>& run) {
+    Key key = std::make_tuple(check, first.get(), second.get(), disabledChecks);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mIndex.find(key);
+        if (it != mIndex.end()) {
+            mResults.splice(mResults.begin(), mResults, it->second);
+            if (!it->second->compatible) {
+                *error = it->second->error;
+            }
+            return it->second->compatible;
+        }
+    }
+
+    // Run the check without holding the lock. If another thread runs the same check
+    // meanwhile, both store the same result.
+    Result result{key, first, second, false, ""};
+    result.compatible = run(&result.error);
+    if (!result.compatible) {
+        *error = result.error;
+    }
+    bool compatible = result.compatible;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCapacity == 0) {
+        return compatible;
+    }
+    auto it = mIndex.find(key);
+    if (it != mIndex.end()) {
+        mResults.erase(it->second);
+        mIndex.erase(it);
+    }
+    mResults.push_front(std::move(result));
+    mIndex.emplace(key, mResults.begin());
+    while (mResults.size() > mCapacity) {
+        mIndex.erase(mResults.back().key);
+        mResults.pop_back();
+    }
+    return compatible;
+}
+
+}  // namespace vintf
+}  // namespace android
@@ -16,6 +16,7 @@
 
 #include "CompatibilityMatrix.h"
 
+#include "KernelRequirementTable.h"
 #include "parse_string.h"
 #include "utils.h"
 
@@ -25,7 +26,7 @@ namespace vintf {
 constexpr Version CompatibilityMatrix::kVersion;
 
 bool CompatibilityMatrix::add(MatrixHal &&hal) {
-    return HalGroup<MatrixHal>::add(std::move(hal));
+    return HalGroup::add(std::move(hal));
 }
 
 bool CompatibilityMatrix::add(MatrixKernel &&kernel) {
@@ -33,6 +34,7 @@ bool CompatibilityMatrix::add(MatrixKernel &&kernel) {
         return false;
     }
     framework.mKernels.push_back(std::move(kernel));
+    mKernelRequirements.reset();
     return true;
 }
 
@@ -42,7 +44,16 @@ SchemaType CompatibilityMatrix::type() const {
 
 
 status_t CompatibilityMatrix::fetchAllInformation(const std::string &path) {
-    return details::fetchAllInformation(path, gCompatibilityMatrixConverter, this);
+    status_t status = details::fetchAllInformation(path, gCompatibilityMatrixConverter,
+                                                   gCompatibilityMatrixBinaryConverter, this);
+    if (status == OK && mType == SchemaType::FRAMEWORK) {
+        buildKernelRequirementTable();
+    }
+    return status;
+}
+
+void CompatibilityMatrix::buildKernelRequirementTable() {
+    mKernelRequirements.set(KernelRequirementTable::build(framework.mKernels));
 }
 
 std::string CompatibilityMatrix::getXmlSchemaPath(const std::string& xmlFileName,
@@ -21,6 +21,9 @@
 
 #include <dirent.h>
 
+#include <stdint.h>
+
+#include <map>
 #include <mutex>
 #include <set>
 
@@ -32,14 +35,102 @@
 namespace android {
 namespace vintf {
 
+namespace details {
+
+// Open addressing hash table from (package, major version, interface, instance)
+// to the minor version and transport of the HAL that provides it.
+struct TransportTable {
+    struct Entry {
+        const std::string* package;
+        size_t majorVer;
+        size_t minorVer;
+        const std::string* interface;
+        const std::string* instance;
+        Transport transport;
+    };
+
+    // Build a table that refers to strings owned by hals. Return nullptr if two
+    // entries share a key, in which case getTransport must search the HALs instead.
+    static std::shared_ptr<const TransportTable> build(
+        const HalManifest::ConstHalIterable& hals) {
+        auto table = std::make_shared<TransportTable>();
+        for (const ManifestHal& hal : hals) {
+            for (const Version& v : hal.versions) {
+                for (const auto& interfacePair : hal.interfaces) {
+                    for (const std::string& instance : interfacePair.second.instances) {
+                        table->mEntries.push_back({&hal.name.str(), v.majorVer, v.minorVer,
+                                                   &interfacePair.first.str(), &instance,
+                                                   hal.transportArch.transport});
+                    }
+                }
+            }
+        }
+        size_t capacity = 8;
+        while (capacity < table->mEntries.size() * 2) {
+            capacity *= 2;
+        }
+        table->mSlots.assign(capacity, kEmptySlot);
+        for (size_t i = 0; i < table->mEntries.size(); ++i) {
+            const Entry& e = table->mEntries[i];
+            size_t slot = table->probe(*e.package, e.majorVer, *e.interface, *e.instance);
+            if (table->mSlots[slot] != kEmptySlot) {
+                return nullptr;
+            }
+            table->mSlots[slot] = i;
+        }
+        return table;
+    }
+
+    // Return the entry with the given key, or nullptr if there is none.
+    const Entry* find(const std::string& package, size_t majorVer, const std::string& interface,
+                      const std::string& instance) const {
+        size_t slot = mSlots[probe(package, majorVer, interface, instance)];
+        return slot == kEmptySlot ? nullptr : &mEntries[slot];
+    }
+
+   private:
+    static constexpr size_t kEmptySlot = SIZE_MAX;
+
+    static size_t hash(const std::string& package, size_t majorVer, const std::string& interface,
+                       const std::string& instance) {
+        std::hash<std::string> h;
+        size_t ret = h(package);
+        ret = ret * 31 + majorVer;
+        ret = ret * 31 + h(interface);
+        ret = ret * 31 + h(instance);
+        return ret;
+    }
+
+    // Return the slot that holds the given key, or the empty slot where it would go.
+    size_t probe(const std::string& package, size_t majorVer, const std::string& interface,
+                 const std::string& instance) const {
+        size_t mask = mSlots.size() - 1;
+        for (size_t slot = hash(package, majorVer, interface, instance) & mask;;
+             slot = (slot + 1) & mask) {
+            if (mSlots[slot] == kEmptySlot) {
+                return slot;
+            }
+            const Entry& e = mEntries[mSlots[slot]];
+            if (e.majorVer == majorVer && *e.package == package && *e.interface == interface &&
+                *e.instance == instance) {
+                return slot;
+            }
+        }
+    }
+
+    std::vector<Entry> mEntries;
+    std::vector<size_t> mSlots;
+};
+
+constexpr size_t TransportTable::kEmptySlot;
+
+}  // namespace details
+
 constexpr Version HalManifest::kVersion;
 
 // Check <version> tag for all <hal> with the same name.
-bool HalManifest::shouldAdd(const ManifestHal& hal) const {
-    if (!hal.isValid()) {
-        return false;
-    }
-    auto existingHals = mHals.equal_range(hal.name);
+std::set<size_t> HalManifest::getMajorVersions(const std::string& name) const {
+    auto existingHals = mHals.equal_range(name);
     std::set<size_t> existingMajorVersions;
     for (auto it = existingHals.first; it != existingHals.second; ++it) {
         for (const auto& v : it->second.versions) {
@@ -47,14 +138,47 @@ bool HalManifest::shouldAdd(const ManifestHal& hal) const {
             existingMajorVersions.insert(v.majorVer);
         }
     }
+    return existingMajorVersions;
+}
+
+// Add the major versions of hal to majorVersions. Return false if any of them is
+// already there.
+static bool addMajorVersions(const ManifestHal& hal, std::set<size_t>* majorVersions) {
     for (const auto& v : hal.versions) {
-        if (!existingMajorVersions.emplace(v.majorVer).second /* no insertion */) {
+        if (!majorVersions->emplace(v.majorVer).second /* no insertion */) {
             return false;
         }
     }
     return true;
 }
 
+bool HalManifest::shouldAdd(const ManifestHal& hal) const {
+    if (!hal.isValid()) {
+        return false;
+    }
+    std::set<size_t> majorVersions = getMajorVersions(hal.name);
+    return addMajorVersions(hal, &majorVersions);
+}
+
+size_t HalManifest::firstRejected(const std::vector<ManifestHal>& hals) const {
+    // Major versions of each name, in mHals and in the hals checked so far.
+    std::map<InternedString, std::set<size_t>> majorVersions;
+    for (size_t i = 0; i < hals.size(); ++i) {
+        const ManifestHal& hal = hals[i];
+        if (!hal.isValid()) {
+            return i;
+        }
+        auto it = majorVersions.find(hal.name);
+        if (it == majorVersions.end()) {
+            it = majorVersions.emplace(hal.name, getMajorVersions(hal.name)).first;
+        }
+        if (!addMajorVersions(hal, &it->second)) {
+            return i;
+        }
+    }
+    return hals.size();
+}
+
 bool HalManifest::shouldAddXmlFile(const ManifestXmlFile& xmlFile) const {
     auto existingXmlFiles = getXmlFiles(xmlFile.name());
     for (auto it = existingXmlFiles.first; it != existingXmlFiles.second; ++it) {
@@ -66,9 +190,12 @@ bool HalManifest::shouldAddXmlFile(const ManifestXmlFile& xmlFile) const {
 }
 
 std::set<std::string> HalManifest::getHalNames() const {
+    // mHals is sorted by name, so each name is appended to the end of the set.
     std::set<std::string> names{};
     for (const auto &hal : mHals) {
-        names.insert(hal.first);
+        if (names.empty() || *names.rbegin() != hal.first) {
+            names.emplace_hint(names.end(), hal.first);
+        }
     }
     return names;
 }
@@ -102,6 +229,7 @@ std::vector<const ManifestHal *> HalManifest::getHals(const std::string &name) c
     return ret;
 }
 std::vector<ManifestHal *> HalManifest::getHals(const std::string &name) {
+    onHalsChanged();
     std::vector<ManifestHal *> ret;
     auto range = mHals.equal_range(name);
     for (auto it = range.first; it != range.second; ++it) {
@@ -113,6 +241,16 @@ std::vector<ManifestHal *> HalManifest::getHals(const std::string &name) {
 Transport HalManifest::getTransport(const std::string &package, const Version &v,
             const std::string &interfaceName, const std::string &instanceName) const {
 
+    const details::TransportTable* table = mTransportTable.get();
+    if (table != nullptr) {
+        // Misses are not logged; formatting the message would cost more than the lookup.
+        const auto* entry = table->find(package, v.majorVer, interfaceName, instanceName);
+        if (entry != nullptr && entry->minorVer >= v.minorVer) {
+            return entry->transport;
+        }
+        return Transport::EMPTY;
+    }
+
     for (const ManifestHal *hal : getHals(package)) {
         bool found = false;
         for (auto& ver : hal->versions) {
@@ -147,8 +285,8 @@ Transport HalManifest::getTransport(const std::string &package, const Version &v
 
 }
 
-ConstMultiMapValueIterable<std::string, ManifestHal> HalManifest::getHals() const {
-    return HalGroup<ManifestHal>::getHals();
+HalManifest::ConstHalIterable HalManifest::getHals() const {
+    return HalGroup::getHals();
 }
 
 std::set<Version> HalManifest::getSupportedVersions(const std::string &name) const {
@@ -178,10 +316,6 @@ bool HalManifest::hasInstance(const std::string &halName,
     return instances.find(instanceName) != instances.end();
 }
 
-using InstancesOfVersion = std::map<std::string /* interface */,
-                                    std::set<std::string /* instance */>>;
-using Instances = std::map<Version, InstancesOfVersion>;
-
 static bool satisfyVersion(const MatrixHal& matrixHal, const Version& manifestHalVersion) {
     for (const VersionRange &matrixVersionRange : matrixHal.versionRanges) {
         // If Compatibility Matrix says 2.5-2.7, the "2.7" is purely informational;
@@ -193,18 +327,21 @@ static bool satisfyVersion(const MatrixHal& matrixHal, const Version& manifestHa
     return false;
 }
 
-// Check if matrixHal.interfaces is a subset of instancesOfVersion
-static bool satisfyAllInstances(const MatrixHal& matrixHal,
-        const InstancesOfVersion &instancesOfVersion) {
+// Check if matrixHal.interfaces is a subset of manifestHal.interfaces. Both maps
+// and all instance sets are sorted, so this is a merge that allocates nothing.
+static bool satisfyAllInstances(const MatrixHal& matrixHal, const ManifestHal& manifestHal) {
+    auto manifestIt = manifestHal.interfaces.begin();
+    auto manifestEnd = manifestHal.interfaces.end();
     for (const auto& matrixHalInterfacePair : matrixHal.interfaces) {
         const std::string& interface = matrixHalInterfacePair.first;
-        auto it = instancesOfVersion.find(interface);
-        if (it == instancesOfVersion.end()) {
+        while (manifestIt != manifestEnd && manifestIt->first < interface) {
+            ++manifestIt;
+        }
+        if (manifestIt == manifestEnd || manifestIt->first != interface) {
             return false;
         }
-        const std::set<std::string>& manifestInterfaceInstances = it->second;
-        const std::set<std::string>& matrixInterfaceInstances =
-                matrixHalInterfacePair.second.instances;
+        const auto& manifestInterfaceInstances = manifestIt->second.instances;
+        const auto& matrixInterfaceInstances = matrixHalInterfacePair.second.instances;
         if (!std::includes(manifestInterfaceInstances.begin(), manifestInterfaceInstances.end(),
                            matrixInterfaceInstances.begin(), matrixInterfaceInstances.end())) {
             return false;
@@ -214,30 +351,22 @@ static bool satisfyAllInstances(const MatrixHal& matrixHal,
 }
 
 bool HalManifest::isCompatible(const MatrixHal& matrixHal) const {
-    Instances instances;
-    // Do the cross product version x interface x instance and sort them,
-    // because interfaces / instances can span in multiple HALs.
-    // This is efficient for small <hal> entries.
-    for (const ManifestHal* manifestHal : getHals(matrixHal.name)) {
-        for (const Version& manifestHalVersion : manifestHal->versions) {
-            instances[manifestHalVersion] = {};
-            for (const auto& halInterfacePair : manifestHal->interfaces) {
-                const std::string& interface = halInterfacePair.first;
-                const auto& toAdd = halInterfacePair.second.instances;
-                instances[manifestHalVersion][interface].insert(toAdd.begin(), toAdd.end());
+    // shouldAdd() ensures that a major version is provided by at most one <hal>
+    // with this name, so the interfaces and instances of a version are exactly
+    // those of the <hal> that lists it.
+    auto range = mHals.equal_range(matrixHal.name);
+    for (auto it = range.first; it != range.second; ++it) {
+        const ManifestHal& manifestHal = it->second;
+        bool versionMatches = false;
+        for (const Version& manifestHalVersion : manifestHal.versions) {
+            if (satisfyVersion(matrixHal, manifestHalVersion)) {
+                versionMatches = true;
+                break;
             }
         }
-    }
-    for (const auto& instanceMapPair : instances) {
-        const Version& manifestHalVersion = instanceMapPair.first;
-        const InstancesOfVersion& instancesOfVersion = instanceMapPair.second;
-        if (!satisfyVersion(matrixHal, manifestHalVersion)) {
-            continue;
-        }
-        if (!satisfyAllInstances(matrixHal, instancesOfVersion)) {
-            continue;
+        if (versionMatches && satisfyAllInstances(matrixHal, manifestHal)) {
+            return true;  // match!
         }
-        return true; // match!
     }
     return false;
 }
@@ -357,7 +486,20 @@ CompatibilityMatrix HalManifest::generateCompatibleMatrix() const {
 }
 
 status_t HalManifest::fetchAllInformation(const std::string &path) {
-    return details::fetchAllInformation(path, gHalManifestConverter, this);
+    status_t status = details::fetchAllInformation(path, gHalManifestConverter,
+                                                   gHalManifestBinaryConverter, this);
+    if (status == OK) {
+        buildTransportTable();
+    }
+    return status;
+}
+
+void HalManifest::buildTransportTable() {
+    mTransportTable.set(details::TransportTable::build(getHals()));
+}
+
+void HalManifest::onHalsChanged() {
+    mTransportTable.reset();
 }
 
 SchemaType HalManifest::type() const {
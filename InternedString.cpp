@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InternedString.h"
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <unordered_map>
+
+namespace android {
+namespace vintf {
+
+// The pool is split into shards by hash, so that threads interning different
+// strings rarely wait for each other. Looking up a string that is already in its
+// shard only takes the shard's lock shared.
+// Nodes of an unordered_map are never moved, so pointers to entries stay valid.
+struct InternedString::Pool {
+    struct Shard {
+        std::shared_timed_mutex mutex;
+        std::unordered_map<std::string, Entry> strings;
+    };
+    static constexpr size_t kShardCount = 16;
+    std::array<Shard, kShardCount> shards;
+};
+
+// The pool is leaked so that InternedStrings in static objects stay valid until exit.
+InternedString::Pool& InternedString::pool() {
+    static Pool* sPool = new Pool();
+    return *sPool;
+}
+
+const std::string& InternedString::emptyString() {
+    static const std::string* sEmpty = new std::string();
+    return *sEmpty;
+}
+
+InternedString::Entry* InternedString::intern(const std::string& s) {
+    if (s.empty()) {
+        return nullptr;
+    }
+    size_t index = std::hash<std::string>()(s) % Pool::kShardCount;
+    Pool::Shard& shard = pool().shards[index];
+    {
+        // An entry in the map always has a reference, because the last one is only
+        // dropped with the lock held exclusively.
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        auto it = shard.strings.find(s);
+        if (it != shard.strings.end()) {
+            it->second.refs.fetch_add(1, std::memory_order_relaxed);
+            return &it->second;
+        }
+    }
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto it = shard.strings.find(s);
+    if (it == shard.strings.end()) {
+        it = shard.strings
+                 .emplace(std::piecewise_construct, std::forward_as_tuple(s),
+                          std::forward_as_tuple())
+                 .first;
+        it->second.string = &it->first;
+        it->second.refs.store(0, std::memory_order_relaxed);
+        it->second.shard = index;
+    }
+    it->second.refs.fetch_add(1, std::memory_order_relaxed);
+    return &it->second;
+}
+
+void InternedString::release(Entry* entry) {
+    // Only the last reference is dropped with the lock held, so that intern() never
+    // revives an entry that is being removed.
+    size_t refs = entry->refs.load(std::memory_order_relaxed);
+    while (refs > 1) {
+        if (entry->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+            return;
+        }
+    }
+    Pool::Shard& shard = pool().shards[entry->shard];
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    if (entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        shard.strings.erase(shard.strings.find(*entry->string));
+    }
+}
+
+size_t InternedString::poolSize() {
+    size_t size = 0;
+    for (Pool::Shard& shard : pool().shards) {
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        size += shard.strings.size();
+    }
+    return size;
+}
+
+InternedString::InternedString(const std::string& s) : mEntry(intern(s)) {}
+
+InternedString::InternedString(const char* s) : mEntry(intern(s)) {}
+
+}  // namespace vintf
+}  // namespace android
@@ -16,18 +16,131 @@
 
 #include "KernelConfigParser.h"
 
-#include <regex>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 
-#define KEY "(CONFIG[\\w_]+)"
-#define COMMENT "(?:#.*)"
-
-static const std::regex sKeyValuePattern("^\\s*" KEY "\\s*=\\s*([^#]+)" COMMENT "?$");
-static const std::regex sNotSetPattern("^\\s*#\\s*" KEY " is not set\\s*$");
-static const std::regex sCommentPattern("^\\s*" COMMENT "$");
+#include <algorithm>
 
 namespace android {
 namespace vintf {
 
+namespace {
+
+// A range of characters within a line. Lines are tokenized in place, without copying.
+struct LineRange {
+    const char* begin;
+    const char* end;
+
+    inline bool empty() const { return begin == end; }
+    inline std::string str() const { return std::string(begin, end); }
+};
+
+inline bool isSpace(char c) {
+    return isspace(static_cast<unsigned char>(c));
+}
+
+inline bool isWordChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+inline void trimLeadingSpaces(LineRange* r) {
+    while (!r->empty() && isSpace(*r->begin)) ++r->begin;
+}
+
+// trim spaces between value and #, value and end of line
+inline void trimTrailingSpaces(LineRange* r) {
+    while (!r->empty() && isSpace(r->end[-1])) --r->end;
+}
+
+// Consume s if r starts with it.
+inline bool consume(LineRange* r, const char* s) {
+    size_t len = strlen(s);
+    if (static_cast<size_t>(r->end - r->begin) < len || memcmp(r->begin, s, len) != 0) {
+        return false;
+    }
+    r->begin += len;
+    return true;
+}
+
+// Consume a key, which is "CONFIG" followed by at least one of [A-Za-z0-9_].
+inline bool consumeKey(LineRange* r, LineRange* key) {
+    const char* begin = r->begin;
+    if (!consume(r, "CONFIG")) {
+        return false;
+    }
+    const char* keyEnd = std::find_if_not(r->begin, r->end, isWordChar);
+    if (keyEnd == r->begin) {
+        r->begin = begin;
+        return false;
+    }
+    *key = {begin, keyEnd};
+    r->begin = keyEnd;
+    return true;
+}
+
+// Whether r is a comment: '#' followed by anything but line breaks.
+inline bool isComment(const LineRange& r) {
+    return !r.empty() && *r.begin == '#' &&
+           std::find_if(r.begin, r.end, [](char c) { return c == '\r' || c == '\n'; }) == r.end;
+}
+
+// Match "   CONFIG_FOO  = bar    #trailing comments". The value must not be empty before
+// trimming.
+bool matchKeyValue(LineRange line, LineRange* key, LineRange* value) {
+    trimLeadingSpaces(&line);
+    if (!consumeKey(&line, key)) {
+        return false;
+    }
+    trimLeadingSpaces(&line);
+    if (!consume(&line, "=")) {
+        return false;
+    }
+    const char* commentBegin = std::find(line.begin, line.end, '#');
+    *value = {line.begin, commentBegin};
+    if (value->empty() || (commentBegin != line.end && !isComment({commentBegin, line.end}))) {
+        return false;
+    }
+    trimLeadingSpaces(value);
+    trimTrailingSpaces(value);
+    return true;
+}
+
+// Match "  # CONFIG_FOO is not set  ".
+bool matchNotSet(LineRange line, LineRange* key) {
+    trimLeadingSpaces(&line);
+    if (!consume(&line, "#")) {
+        return false;
+    }
+    trimLeadingSpaces(&line);
+    if (!consumeKey(&line, key) || !consume(&line, " is not set")) {
+        return false;
+    }
+    trimLeadingSpaces(&line);
+    return line.empty();
+}
+
+// Match "   #comments here".
+bool matchComment(LineRange line) {
+    trimLeadingSpaces(&line);
+    return isComment(line);
+}
+
+inline bool isGzip(const char* data, size_t len) {
+    return len >= 2 && static_cast<unsigned char>(data[0]) == 0x1f &&
+           static_cast<unsigned char>(data[1]) == 0x8b;
+}
+
+}  // namespace
+
+constexpr size_t KernelConfigParser::kDefaultChunkSize;
+
 KernelConfigParser::KernelConfigParser(bool processComments, bool relaxedFormat)
     : mProcessComments(processComments), mRelaxedFormat(relaxedFormat) {}
 
@@ -47,89 +160,223 @@ const std::map<std::string, std::string>& KernelConfigParser::configs() const {
     return mConfigs;
 }
 
-// trim spaces between value and #, value and end of line
-std::string trimTrailingSpaces(const std::string& s) {
-    auto r = s.rbegin();
-    for (; r != s.rend() && std::isspace(*r); ++r)
-        ;
-    return std::string{s.begin(), r.base()};
-}
+status_t KernelConfigParser::processLine(const char* begin, const char* end) {
+    LineRange line{begin, end};
 
-status_t KernelConfigParser::processRemaining() {
-
-    if (mRemaining.empty()) {
+    if (line.empty()) {
         return OK;
     }
 
-    std::smatch match;
+    LineRange key;
+    LineRange value;
 
     if (mRelaxedFormat) {
         // Allow free format like "   CONFIG_FOO  = bar    #trailing comments"
-        if (std::regex_match(mRemaining, match, sKeyValuePattern)) {
-            if (mConfigs.emplace(match[1], trimTrailingSpaces(match[2])).second) {
+        if (matchKeyValue(line, &key, &value)) {
+            if (mConfigs.emplace(key.str(), value.str()).second) {
                 return OK;
             }
-            mError << "Duplicated key in configs: " << match[1] << "\n";
+            mError << "Duplicated key in configs: " << key.str() << "\n";
             return UNKNOWN_ERROR;
         }
     } else {
         // No spaces. Strictly like "CONFIG_FOO=bar"
-        size_t equalPos = mRemaining.find('=');
-        if (equalPos != std::string::npos) {
-            std::string key = mRemaining.substr(0, equalPos);
-            std::string value = mRemaining.substr(equalPos + 1);
-            if (mConfigs.emplace(std::move(key), std::move(value)).second) {
+        const char* equalPos = std::find(line.begin, line.end, '=');
+        if (equalPos != line.end) {
+            key = {line.begin, equalPos};
+            value = {equalPos + 1, line.end};
+            if (mConfigs.emplace(key.str(), value.str()).second) {
                 return OK;
             }
-            mError << "Duplicated key in configs: " << mRemaining.substr(0, equalPos) << "\n";
+            mError << "Duplicated key in configs: " << key.str() << "\n";
             return UNKNOWN_ERROR;
         }
     }
 
-    if (mProcessComments && std::regex_match(mRemaining, match, sNotSetPattern)) {
-        if (mConfigs.emplace(match[1], "n").second) {
+    if (mProcessComments && matchNotSet(line, &key)) {
+        if (mConfigs.emplace(key.str(), "n").second) {
             return OK;
         }
-        mError << "Key " << match[1] << " is set but commented as not set"
+        mError << "Key " << key.str() << " is set but commented as not set"
                << "\n";
         return UNKNOWN_ERROR;
     }
 
     if (mRelaxedFormat) {
         // Allow free format like "   #comments here"
-        if (std::regex_match(mRemaining, match, sCommentPattern)) {
+        if (matchComment(line)) {
             return OK;
         }
     } else {
         // No leading spaces before the comment
-        if (mRemaining.at(0) == '#') {
+        if (*line.begin == '#') {
             return OK;
         }
     }
 
-    mError << "Unrecognized line in configs: " << mRemaining << "\n";
+    mError << "Unrecognized line in configs: " << line.str() << "\n";
     return UNKNOWN_ERROR;
 }
 
 status_t KernelConfigParser::process(const char* buf, size_t len) {
     const char* begin = buf;
-    const char* end = buf;
     const char* stop = buf + len;
+    const char* end;
     status_t err = OK;
-    while (end < stop) {
-        if (*end == '\n') {
-            mRemaining.insert(mRemaining.size(), begin, end - begin);
-            status_t newErr = processRemaining();
-            if (newErr != OK && err == OK) {
-                err = newErr;
-                // but continue to get more
-            }
+    while (begin != stop &&
+           (end = static_cast<const char*>(memchr(begin, '\n', stop - begin))) != nullptr) {
+        status_t newErr;
+        if (mRemaining.empty()) {
+            // The whole line is in buf; parse it in place.
+            newErr = processLine(begin, end);
+        } else {
+            // The line starts in a previous buffer.
+            mRemaining.append(begin, end);
+            newErr = processLine(mRemaining.data(), mRemaining.data() + mRemaining.size());
             mRemaining.clear();
-            begin = end + 1;
         }
-        end++;
+        if (newErr != OK && err == OK) {
+            err = newErr;
+            // but continue to get more
+        }
+        begin = end + 1;
+    }
+    mRemaining.append(begin, stop);
+    return err;
+}
+
+status_t KernelConfigParser::processFile(const std::string& path, size_t chunkSize) {
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        int savedErrno = errno;
+        mError << "Cannot open " << path << ": " << strerror(savedErrno) << "\n";
+        return -savedErrno;
+    }
+    status_t err = processFile(fd, chunkSize);
+    close(fd);
+    return err;
+}
+
+status_t KernelConfigParser::processFile(int fd, size_t chunkSize) {
+    chunkSize = std::max<size_t>(chunkSize, 2);
+
+    // Map regular files and process them as a single piece. Files in /proc cannot
+    // be mapped; they are read in pieces of chunkSize bytes instead.
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= UINT_MAX) {
+        size_t size = st.st_size;
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            bool done = false;
+            status_t err = processStream(
+                [&](const char** data) -> ssize_t {
+                    *data = static_cast<const char*>(addr);
+                    ssize_t ret = done ? 0 : size;
+                    done = true;
+                    return ret;
+                },
+                chunkSize);
+            munmap(addr, size);
+            return err;
+        }
+    }
+
+    mInputBuffer.resize(chunkSize);
+    return processStream(
+        [&](const char** data) -> ssize_t {
+            // Fill the buffer, so that the gzip header is seen in the first piece.
+            size_t size = 0;
+            while (size < chunkSize) {
+                ssize_t n =
+                    TEMP_FAILURE_RETRY(read(fd, mInputBuffer.data() + size, chunkSize - size));
+                if (n < 0) {
+                    return -errno;
+                }
+                if (n == 0) {
+                    break;
+                }
+                size += n;
+            }
+            *data = mInputBuffer.data();
+            return size;
+        },
+        chunkSize);
+}
+
+status_t KernelConfigParser::processStream(const std::function<ssize_t(const char**)>& read,
+                                           size_t chunkSize) {
+    const char* in;
+    ssize_t inLen = read(&in);
+
+    if (inLen <= 0 || !isGzip(in, inLen)) {
+        // Not compressed; parse the input as is.
+        for (; inLen > 0; inLen = read(&in)) {
+            process(in, inLen);
+        }
+        finish();
+        if (inLen < 0) {
+            mError << "Cannot read kernel configs: " << strerror(-inLen) << "\n";
+            return inLen;
+        }
+        return OK;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16: decode gzip headers.
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        mError << "Cannot decompress kernel configs: " << (stream.msg ? stream.msg : "") << "\n";
+        return NO_MEMORY;
+    }
+    mOutputBuffer.resize(chunkSize);
+
+    status_t err = OK;
+    bool streamEnded = false;
+    bool trailingData = false;
+    for (; inLen > 0 && err == OK && !trailingData; inLen = read(&in)) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        stream.avail_in = inLen;
+        // Keep inflating while there is input or the last output filled the buffer.
+        do {
+            if (streamEnded) {
+                // Like gzread(), continue with a concatenated gzip stream, and ignore
+                // anything else after the end of a stream.
+                if (!isGzip(reinterpret_cast<const char*>(stream.next_in), stream.avail_in)) {
+                    trailingData = stream.avail_in > 0;
+                    break;
+                }
+                inflateReset(&stream);
+                streamEnded = false;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(mOutputBuffer.data());
+            stream.avail_out = chunkSize;
+            int ret = inflate(&stream, Z_NO_FLUSH);
+            if (ret == Z_BUF_ERROR) {
+                // Needs more input.
+                break;
+            }
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                mError << "Cannot decompress kernel configs: " << (stream.msg ? stream.msg : "")
+                       << "\n";
+                err = BAD_VALUE;
+                break;
+            }
+            // The parser consumes the output in place. Only a line that continues
+            // in the next chunk is copied.
+            process(mOutputBuffer.data(), chunkSize - stream.avail_out);
+            streamEnded = ret == Z_STREAM_END;
+        } while (stream.avail_in > 0 || stream.avail_out == 0);
+    }
+    if (err == OK && inLen < 0) {
+        mError << "Cannot read kernel configs: " << strerror(-inLen) << "\n";
+        err = inLen;
+    }
+    if (err == OK && !streamEnded) {
+        mError << "Cannot decompress kernel configs: unexpected end of file\n";
+        err = BAD_VALUE;
     }
-    mRemaining.insert(mRemaining.size(), begin, end - begin);
+    inflateEnd(&stream);
+    finish();
     return err;
 }
 
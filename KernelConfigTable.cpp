@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelConfigTable.h"
+
+#include <string.h>
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace android {
+namespace vintf {
+
+namespace {
+
+// Same order as std::string::compare.
+inline int compareKeys(const char* a, size_t aLength, const char* b, size_t bLength) {
+    int r = memcmp(a, b, std::min(aLength, bLength));
+    if (r != 0) return r;
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+}  // namespace
+
+KernelConfigTable::KernelConfigTable(const std::map<std::string, std::string>& configs) {
+    build(configs.begin(), configs.end());
+}
+
+KernelConfigTable::KernelConfigTable(std::initializer_list<value_type> configs) {
+    std::vector<value_type> sorted(configs);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    sorted.erase(std::unique(sorted.begin(), sorted.end(),
+                             [](const auto& a, const auto& b) { return a.first == b.first; }),
+                 sorted.end());
+    build(sorted.begin(), sorted.end());
+}
+
+template <typename Iterator>
+void KernelConfigTable::build(Iterator begin, Iterator end) {
+    size_t stringsSize = 0;
+    for (auto it = begin; it != end; ++it) {
+        stringsSize += it->first.size() + it->second.size();
+    }
+    mStrings.clear();
+    mStrings.reserve(stringsSize);
+    mEntries.clear();
+    mEntries.reserve(std::distance(begin, end));
+    mValues.clear();
+
+    // Most values are "y" or "m", so store and parse each distinct value once.
+    std::unordered_map<std::string, uint32_t> valueIndices;
+    for (auto it = begin; it != end; ++it) {
+        const std::string& key = it->first;
+        const std::string& value = it->second;
+        Entry entry;
+        entry.keyOffset = mStrings.size();
+        entry.keyLength = key.size();
+        mStrings.append(key);
+        auto inserted = valueIndices.emplace(value, mValues.size());
+        if (inserted.second) {
+            Value stored{static_cast<uint32_t>(mStrings.size()), ParsedKernelConfigValue(value)};
+            stored.parsed.length = value.size();
+            mValues.push_back(stored);
+            mStrings.append(value);
+        }
+        entry.valueIndex = inserted.first->second;
+        mEntries.push_back(entry);
+    }
+    mStrings.shrink_to_fit();
+    mValues.shrink_to_fit();
+}
+
+size_t KernelConfigTable::lowerBound(const char* key, size_t keyLength) const {
+    const char* strings = mStrings.data();
+    auto it = std::lower_bound(mEntries.begin(), mEntries.end(), key,
+                               [strings, keyLength](const Entry& entry, const char* key) {
+                                   return compareKeys(strings + entry.keyOffset, entry.keyLength,
+                                                      key, keyLength) < 0;
+                               });
+    return it - mEntries.begin();
+}
+
+bool KernelConfigTable::keyEquals(const Entry& entry, const char* key, size_t keyLength) const {
+    return entry.keyLength == keyLength &&
+           memcmp(mStrings.data() + entry.keyOffset, key, keyLength) == 0;
+}
+
+bool KernelConfigTable::lookup(const char* key, size_t keyLength,
+                               ParsedKernelConfigValue* value) const {
+    size_t index = lowerBound(key, keyLength);
+    if (index == mEntries.size() || !keyEquals(mEntries[index], key, keyLength)) {
+        return false;
+    }
+    const Value& stored = mValues[mEntries[index].valueIndex];
+    *value = stored.parsed;
+    value->string = mStrings.data() + stored.offset;
+    return true;
+}
+
+KernelConfigTable::const_iterator KernelConfigTable::find(const std::string& key) const {
+    size_t index = lowerBound(key.data(), key.size());
+    if (index == mEntries.size() || !keyEquals(mEntries[index], key.data(), key.size())) {
+        return end();
+    }
+    return const_iterator(this, index);
+}
+
+std::string KernelConfigTable::at(const std::string& key) const {
+    size_t index = lowerBound(key.data(), key.size());
+    CHECK(index < mEntries.size() && keyEquals(mEntries[index], key.data(), key.size()))
+        << "No kernel config " << key;
+    return valueAt(mEntries[index]);
+}
+
+KernelConfigTable::value_type KernelConfigTable::entryAt(size_t index) const {
+    const Entry& entry = mEntries[index];
+    return value_type(mStrings.substr(entry.keyOffset, entry.keyLength), valueAt(entry));
+}
+
+std::string KernelConfigTable::valueAt(const Entry& entry) const {
+    const Value& stored = mValues[entry.valueIndex];
+    return mStrings.substr(stored.offset, stored.parsed.length);
+}
+
+bool KernelConfigTable::operator==(const KernelConfigTable& other) const {
+    if (size() != other.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < mEntries.size(); ++i) {
+        const Entry& a = mEntries[i];
+        const Entry& b = other.mEntries[i];
+        const Value& aValue = mValues[a.valueIndex];
+        const Value& bValue = other.mValues[b.valueIndex];
+        if (compareKeys(mStrings.data() + a.keyOffset, a.keyLength,
+                        other.mStrings.data() + b.keyOffset, b.keyLength) != 0 ||
+            compareKeys(mStrings.data() + aValue.offset, aValue.parsed.length,
+                        other.mStrings.data() + bValue.offset, bValue.parsed.length) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace vintf
+}  // namespace android
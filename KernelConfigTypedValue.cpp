@@ -18,6 +18,8 @@
 
 #include "parse_string.h"
 
+#include <string.h>
+
 #include <android-base/logging.h>
 
 namespace android {
@@ -26,6 +28,12 @@ namespace vintf {
 // static
 const KernelConfigTypedValue KernelConfigTypedValue::gMissingConfig{Tristate::NO};
 
+ParsedKernelConfigValue::ParsedKernelConfigValue(const std::string &s) {
+    isTristate = parse(s, &tristateValue);
+    isInteger = parseKernelConfigInt(s, &integerValue);
+    isRange = parseRange(s, &rangeValue);
+}
+
 KernelConfigTypedValue::KernelConfigTypedValue()
         : KernelConfigTypedValue("") {
 }
@@ -86,5 +94,21 @@ bool KernelConfigTypedValue::matchValue(const std::string &s) const {
     }
 }
 
+bool KernelConfigTypedValue::matchValue(const ParsedKernelConfigValue &v) const {
+    switch(mType) {
+        case KernelConfigType::STRING:
+            // Same as ("\"" + mStringValue + "\"") == v.string
+            return v.length == mStringValue.size() + 2 && v.string[0] == '"' &&
+                   v.string[v.length - 1] == '"' &&
+                   memcmp(v.string + 1, mStringValue.data(), mStringValue.size()) == 0;
+        case KernelConfigType::INTEGER:
+            return v.isInteger && v.integerValue == mIntegerValue;
+        case KernelConfigType::RANGE:
+            return v.isRange && v.rangeValue == mRangeValue;
+        case KernelConfigType::TRISTATE:
+            return v.isTristate && v.tristateValue == mTristateValue;
+    }
+}
+
 } // namespace vintf
 } // namespace android
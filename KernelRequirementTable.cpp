@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelRequirementTable.h"
+
+#include <map>
+#include <sstream>
+
+#include "RuntimeInfo.h"
+#include "parse_string.h"
+
+namespace android {
+namespace vintf {
+
+std::shared_ptr<const KernelRequirementTable> KernelRequirementTable::build(
+    const std::vector<MatrixKernel>& kernels) {
+    auto table = std::make_shared<KernelRequirementTable>();
+
+    std::map<std::string, uint32_t> slots;
+    for (const MatrixKernel& kernel : kernels) {
+        for (const auto* configs : {&kernel.conditions(), &kernel.configs()}) {
+            for (const KernelConfig& config : *configs) {
+                slots.emplace(config.first, 0);
+            }
+        }
+    }
+    table->mKeys.reserve(slots.size());
+    for (auto& pair : slots) {
+        pair.second = table->mKeys.size();
+        table->mKeys.push_back(pair.first);
+    }
+
+    // Requirements on each slot; there are only a few distinct values per key.
+    std::vector<std::vector<uint32_t>> requirementsBySlot(table->mKeys.size());
+    auto addRequirement = [&](const KernelConfig& config) {
+        uint32_t slot = slots.at(config.first);
+        for (uint32_t index : requirementsBySlot[slot]) {
+            if (table->mRequirements[index].value == config.second) {
+                table->mRequirementIndices.push_back(index);
+                return;
+            }
+        }
+        uint32_t index = table->mRequirements.size();
+        table->mRequirements.push_back({slot, config.second});
+        requirementsBySlot[slot].push_back(index);
+        table->mRequirementIndices.push_back(index);
+    };
+    table->mFragments.reserve(kernels.size());
+    for (const MatrixKernel& kernel : kernels) {
+        Fragment fragment;
+        fragment.minLts = kernel.minLts();
+        fragment.conditionsBegin = table->mRequirementIndices.size();
+        for (const KernelConfig& config : kernel.conditions()) {
+            addRequirement(config);
+        }
+        fragment.configsBegin = table->mRequirementIndices.size();
+        for (const KernelConfig& config : kernel.configs()) {
+            addRequirement(config);
+        }
+        fragment.configsEnd = table->mRequirementIndices.size();
+        table->mFragments.push_back(fragment);
+    }
+    return table;
+}
+
+// Looks up slots and evaluates requirements on first use, and remembers the results.
+class KernelRequirementTable::Matcher {
+   public:
+    Matcher(const KernelRequirementTable& table, const RuntimeInfo& runtimeInfo)
+        : mTable(table),
+          mRuntimeInfo(runtimeInfo),
+          mSlots(table.mKeys.size()),
+          mRequirements(table.mRequirements.size(), State::UNKNOWN) {}
+
+    // Return true if all requirements in [begin, end) of mRequirementIndices are met.
+    bool matchRange(uint32_t begin, uint32_t end, std::string* error) {
+        for (uint32_t i = begin; i < end; ++i) {
+            uint32_t index = mTable.mRequirementIndices[i];
+            if (mRequirements[index] == State::UNKNOWN) {
+                mRequirements[index] = evaluate(index) ? State::MET : State::UNMET;
+            }
+            if (mRequirements[index] == State::UNMET) {
+                if (error != nullptr) {
+                    *error = describe(index);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+   private:
+    enum class State : uint8_t { UNKNOWN, MET, UNMET };
+    struct Slot {
+        bool lookedUp = false;
+        bool found = false;
+        ParsedKernelConfigValue value;
+    };
+
+    Slot& slot(uint32_t index) {
+        Slot& s = mSlots[index];
+        if (!s.lookedUp) {
+            const std::string& key = mTable.mKeys[index];
+            s.found = mRuntimeInfo.kernelConfigs().lookup(key.data(), key.size(), &s.value);
+            s.lookedUp = true;
+        }
+        return s;
+    }
+
+    bool evaluate(uint32_t index) {
+        const Requirement& requirement = mTable.mRequirements[index];
+        const Slot& s = slot(requirement.slot);
+        if (!s.found) {
+            // special case: <value type="tristate">n</value> matches if the config doesn't exist.
+            return requirement.value == KernelConfigTypedValue::gMissingConfig;
+        }
+        return requirement.value.matchValue(s.value);
+    }
+
+    std::string describe(uint32_t index) {
+        const Requirement& requirement = mTable.mRequirements[index];
+        const std::string& key = mTable.mKeys[requirement.slot];
+        const Slot& s = slot(requirement.slot);
+        if (!s.found) {
+            return "Missing config " + key;
+        }
+        return "For config " + key + ", value = " + std::string(s.value.string, s.value.length) +
+               " but required " + to_string(requirement.value);
+    }
+
+    const KernelRequirementTable& mTable;
+    const RuntimeInfo& mRuntimeInfo;
+    std::vector<Slot> mSlots;
+    std::vector<State> mRequirements;
+};
+
+bool KernelRequirementTable::match(const RuntimeInfo& runtimeInfo, std::string* error) const {
+    Matcher matcher(*this, runtimeInfo);
+    bool foundMatchedKernelVersion = false;
+    bool foundMatchedConditions = false;
+    for (const Fragment& fragment : mFragments) {
+        if (!runtimeInfo.matchKernelVersion(fragment.minLts)) {
+            continue;
+        }
+        foundMatchedKernelVersion = true;
+        // ignore this fragment if not all conditions are met.
+        if (!matcher.matchRange(fragment.conditionsBegin, fragment.configsBegin, error)) {
+            continue;
+        }
+        foundMatchedConditions = true;
+        if (!matcher.matchRange(fragment.configsBegin, fragment.configsEnd, error)) {
+            return false;
+        }
+    }
+    if (!foundMatchedKernelVersion) {
+        if (error != nullptr) {
+            std::stringstream ss;
+            ss << "Framework is incompatible with kernel version " << runtimeInfo.kernelVersion()
+               << ", compatible kernel versions are";
+            for (const Fragment& fragment : mFragments) ss << " " << fragment.minLts;
+            *error = ss.str();
+        }
+        return false;
+    }
+    if (!foundMatchedConditions) {
+        // This should not happen because first <conditions> for each <kernel> must be
+        // empty. Reject here for inconsistency.
+        if (error != nullptr) {
+            error->insert(0, "Framework match kernel version with unmet conditions:");
+        }
+        return false;
+    }
+    return true;
+}
+
+}  // namespace vintf
+}  // namespace android
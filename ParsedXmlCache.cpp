@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ParsedXmlCache.h"
+
+#include "CompatibilityMatrix.h"
+#include "HalManifest.h"
+#include "parse_xml.h"
+
+namespace android {
+namespace vintf {
+
+constexpr size_t ParsedXmlCache::kDefaultCapacity;
+
+ParsedXmlCache::ParsedXmlCache(size_t capacity) : mCapacity(capacity) {}
+
+bool ParsedXmlCache::parse(const std::string& xml, std::shared_ptr<const HalManifest>* manifest,
+                           std::shared_ptr<const CompatibilityMatrix>* matrix) {
+    size_t hash = std::hash<std::string>()(xml);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mIndex.find(hash);
+        if (it != mIndex.end() && it->second->xml == xml) {
+            ++mStats.hits;
+            mEntries.splice(mEntries.begin(), mEntries, it->second);
+            *manifest = it->second->manifest;
+            *matrix = it->second->matrix;
+            return true;
+        }
+        ++mStats.misses;
+    }
+
+    // Parse without holding the lock, so that XMLs are still parsed in parallel.
+    // The root element decides which one, so that a matrix is not parsed as a
+    // manifest first.
+    Entry entry{hash, xml, nullptr, nullptr};
+    std::string root = getRootElementName(xml);
+    std::shared_ptr<HalManifest> parsedManifest;
+    std::shared_ptr<CompatibilityMatrix> parsedMatrix;
+    if (root != "compatibility-matrix" &&
+        gHalManifestConverter((parsedManifest = std::make_shared<HalManifest>()).get(), xml)) {
+        entry.manifest = std::move(parsedManifest);
+    } else if (root != "manifest" &&
+               gCompatibilityMatrixConverter(
+                   (parsedMatrix = std::make_shared<CompatibilityMatrix>()).get(), xml)) {
+        // The matrix may be checked against the runtime info many times.
+        if (parsedMatrix->type() == SchemaType::FRAMEWORK) {
+            parsedMatrix->buildKernelRequirementTable();
+        }
+        entry.matrix = std::move(parsedMatrix);
+    } else {
+        return false;
+    }
+    *manifest = entry.manifest;
+    *matrix = entry.matrix;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCapacity == 0) {
+        return true;
+    }
+    auto it = mIndex.find(hash);
+    if (it != mIndex.end()) {
+        // Parsed concurrently by another thread, or a hash collision; keep the newest.
+        mEntries.erase(it->second);
+        mIndex.erase(it);
+    }
+    mEntries.push_front(std::move(entry));
+    mIndex.emplace(hash, mEntries.begin());
+    evict(mCapacity);
+    return true;
+}
+
+void ParsedXmlCache::evict(size_t capacity) {
+    while (mEntries.size() > capacity) {
+        mIndex.erase(mEntries.back().hash);
+        mEntries.pop_back();
+        ++mStats.evictions;
+    }
+}
+
+void ParsedXmlCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCapacity = capacity;
+    evict(capacity);
+}
+
+size_t ParsedXmlCache::capacity() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCapacity;
+}
+
+ParsedXmlCache::Stats ParsedXmlCache::stats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Stats stats = mStats;
+    stats.size = mEntries.size();
+    stats.capacity = mCapacity;
+    return stats;
+}
+
+void ParsedXmlCache::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mIndex.clear();
+    mStats = Stats{};
+}
+
+}  // namespace vintf
+}  // namespace android
@@ -23,8 +23,9 @@
 namespace android {
 namespace vintf {
 
-status_t RuntimeInfo::fetchAllInformation() {
+status_t RuntimeInfo::fetchAllInformation(FetchFlags flags, bool /* parallel */) {
     LOG(WARNING) << "Should not run fetchAllInformation on host.";
+    mFetchedFlags |= flags;
     return OK;
 }
 
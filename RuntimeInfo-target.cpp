@@ -23,6 +23,7 @@
 #include "CompatibilityMatrix.h"
 #include "KernelConfigParser.h"
 #include "parse_string.h"
+#include "utils.h"
 
 #include <dirent.h>
 #include <errno.h>
@@ -32,20 +33,19 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include <cutils/properties.h>
 #include <selinux/selinux.h>
-#include <zlib.h>
 
 #define PROC_CONFIG "/proc/config.gz"
-#define BUFFER_SIZE sysconf(_SC_PAGESIZE)
 
 namespace android {
 namespace vintf {
 
 struct RuntimeInfoFetcher {
     RuntimeInfoFetcher(RuntimeInfo *ki) : mRuntimeInfo(ki) { }
-    status_t fetchAllInformation();
+    status_t fetchAllInformation(RuntimeInfo::FetchFlags flags, bool parallel);
 private:
     status_t fetchVersion();
     status_t fetchKernelConfigs();
@@ -59,26 +59,10 @@ private:
 
 // decompress /proc/config.gz and read its contents.
 status_t RuntimeInfoFetcher::fetchKernelConfigs() {
-    gzFile f = gzopen(PROC_CONFIG, "rb");
-    if (f == NULL) {
-        LOG(ERROR) << "Could not open /proc/config.gz: " << errno;
-        return -errno;
-    }
-
-    char buf[BUFFER_SIZE];
-    int len;
-    while ((len = gzread(f, buf, sizeof buf)) > 0) {
-        mConfigParser.process(buf, len);
-    }
-    status_t err = OK;
-    if (len < 0) {
-        int errnum;
-        const char *errmsg = gzerror(f, &errnum);
-        LOG(ERROR) << "Could not read /proc/config.gz: " << errmsg;
-        err = (errnum == Z_ERRNO ? -errno : errnum);
+    status_t err = mConfigParser.processFile(PROC_CONFIG);
+    if (err != OK) {
+        LOG(ERROR) << "Could not read " PROC_CONFIG ": " << mConfigParser.error()->str();
     }
-    mConfigParser.finish();
-    gzclose(f);
     mRuntimeInfo->mKernelConfigs = std::move(mConfigParser.configs());
     return err;
 }
@@ -159,28 +143,48 @@ status_t RuntimeInfoFetcher::fetchAvb() {
     return OK;
 }
 
-status_t RuntimeInfoFetcher::fetchAllInformation() {
-    status_t err;
-    if ((err = fetchVersion()) != OK) {
-        LOG(WARNING) << "Cannot fetch or parse /proc/version: " << strerror(-err);
-    }
-    if ((err = fetchKernelConfigs()) != OK) {
-        LOG(WARNING) << "Cannot fetch or parse /proc/config.gz: " << strerror(-err);
-    }
-    if ((err = fetchCpuInfo()) != OK) {
-        LOG(WARNING) << "Cannot fetch /proc/cpuinfo: " << strerror(-err);
-    }
-    if ((err = fetchKernelSepolicyVers()) != OK) {
-        LOG(WARNING) << "Cannot fetch kernel sepolicy version: " << strerror(-err);
-    }
-    if ((err = fetchAvb()) != OK) {
-        LOG(WARNING) << "Cannot fetch sepolicy avb version: " << strerror(-err);
-    }
+status_t RuntimeInfoFetcher::fetchAllInformation(RuntimeInfo::FetchFlags flags, bool parallel) {
+    // Each step writes different fields of mRuntimeInfo, so they can run concurrently.
+    static const struct {
+        RuntimeInfo::FetchFlag flag;
+        status_t (RuntimeInfoFetcher::*fetch)();
+        const char *warning;
+        // Slow steps read and decode whole files. uname() and property reads
+        // cost less than starting a thread.
+        bool slow;
+    } kSteps[] = {
+        {RuntimeInfo::CPU_VERSION, &RuntimeInfoFetcher::fetchVersion,
+         "Cannot fetch or parse /proc/version: ", false},
+        {RuntimeInfo::CONFIG_GZ, &RuntimeInfoFetcher::fetchKernelConfigs,
+         "Cannot fetch or parse /proc/config.gz: ", true},
+        {RuntimeInfo::CPU_INFO, &RuntimeInfoFetcher::fetchCpuInfo,
+         "Cannot fetch /proc/cpuinfo: ", true},
+        {RuntimeInfo::POLICYVERS, &RuntimeInfoFetcher::fetchKernelSepolicyVers,
+         "Cannot fetch kernel sepolicy version: ", false},
+        {RuntimeInfo::AVB, &RuntimeInfoFetcher::fetchAvb,
+         "Cannot fetch sepolicy avb version: ", false},
+    };
+
+    std::vector<const char *> warnings;
+    std::vector<details::FetchStep> steps;
+    for (const auto &step : kSteps) {
+        if (flags & step.flag) {
+            warnings.push_back(step.warning);
+            steps.push_back({std::bind(step.fetch, this), step.slow});
+        }
+    }
+    std::vector<status_t> results = details::runFetchSteps(steps, parallel);
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i] != OK) {
+            LOG(WARNING) << warnings[i] << strerror(-results[i]);
+        }
+    }
+    mRuntimeInfo->mFetchedFlags |= flags;
     return OK;
 }
 
-status_t RuntimeInfo::fetchAllInformation() {
-    return RuntimeInfoFetcher(this).fetchAllInformation();
+status_t RuntimeInfo::fetchAllInformation(FetchFlags flags, bool parallel) {
+    return RuntimeInfoFetcher(this).fetchAllInformation(flags, parallel);
 }
 
 } // namespace vintf
@@ -20,6 +20,7 @@
 #include "RuntimeInfo.h"
 
 #include "CompatibilityMatrix.h"
+#include "KernelRequirementTable.h"
 #include "parse_string.h"
 
 namespace android {
@@ -49,10 +50,14 @@ const KernelVersion &RuntimeInfo::kernelVersion() const {
     return mKernelVersion;
 }
 
-const std::map<std::string, std::string> &RuntimeInfo::kernelConfigs() const {
+const KernelConfigTable &RuntimeInfo::kernelConfigs() const {
     return mKernelConfigs;
 }
 
+RuntimeInfo::FetchFlags RuntimeInfo::fetchedFlags() const {
+    return mFetchedFlags;
+}
+
 size_t RuntimeInfo::kernelSepolicyVersion() const {
     return mKernelSepolicyVersion;
 }
@@ -73,8 +78,8 @@ bool RuntimeInfo::matchKernelConfigs(const std::vector<KernelConfig>& matrixConf
                                      std::string* error) const {
     for (const KernelConfig& matrixConfig : matrixConfigs) {
         const std::string& key = matrixConfig.first;
-        auto it = this->mKernelConfigs.find(key);
-        if (it == this->mKernelConfigs.end()) {
+        ParsedKernelConfigValue kernelValue;
+        if (!this->mKernelConfigs.lookup(key.data(), key.size(), &kernelValue)) {
             // special case: <value type="tristate">n</value> matches if the config doesn't exist.
             if (matrixConfig.second == KernelConfigTypedValue::gMissingConfig) {
                 continue;
@@ -84,10 +89,10 @@ bool RuntimeInfo::matchKernelConfigs(const std::vector<KernelConfig>& matrixConf
             }
             return false;
         }
-        const std::string& kernelValue = it->second;
         if (!matrixConfig.second.matchValue(kernelValue)) {
             if (error != nullptr) {
-                *error = "For config " + key + ", value = " + kernelValue + " but required " +
+                *error = "For config " + key + ", value = " +
+                         std::string(kernelValue.string, kernelValue.length) + " but required " +
                          to_string(matrixConfig.second);
             }
             return false;
@@ -101,29 +106,11 @@ bool RuntimeInfo::matchKernelVersion(const KernelVersion& minLts) const {
            minLts.minorRev <= mKernelVersion.minorRev;
 }
 
-bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string* error,
-                                     DisabledChecks disabledChecks) const {
-    if (mat.mType != SchemaType::FRAMEWORK) {
-        if (error != nullptr) {
-            *error = "Should not check runtime info against " + to_string(mat.mType)
-                    + " compatibility matrix.";
-        }
-        return false;
-    }
-    if (kernelSepolicyVersion() != mat.framework.mSepolicy.kernelSepolicyVersion()) {
-        if (error != nullptr) {
-            *error = "kernelSepolicyVersion = " + to_string(kernelSepolicyVersion())
-                     + " but required " + to_string(mat.framework.mSepolicy.kernelSepolicyVersion());
-        }
-        return false;
-    }
-
-    // mat.mSepolicy.sepolicyVersion() is checked against static
-    // HalManifest.device.mSepolicyVersion in HalManifest::checkCompatibility.
-
+bool RuntimeInfo::matchKernels(const std::vector<MatrixKernel>& kernels,
+                               std::string* error) const {
     bool foundMatchedKernelVersion = false;
     bool foundMatchedConditions = false;
-    for (const MatrixKernel& matrixKernel : mat.framework.mKernels) {
+    for (const MatrixKernel& matrixKernel : kernels) {
         if (!matchKernelVersion(matrixKernel.minLts())) {
             continue;
         }
@@ -142,7 +129,7 @@ bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string
             std::stringstream ss;
             ss << "Framework is incompatible with kernel version " << mKernelVersion
                << ", compatible kernel versions are";
-            for (const MatrixKernel& matrixKernel : mat.framework.mKernels)
+            for (const MatrixKernel& matrixKernel : kernels)
                 ss << " " << matrixKernel.minLts();
             *error = ss.str();
         }
@@ -156,6 +143,34 @@ bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string
         }
         return false;
     }
+    return true;
+}
+
+bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string* error,
+                                     DisabledChecks disabledChecks) const {
+    if (mat.mType != SchemaType::FRAMEWORK) {
+        if (error != nullptr) {
+            *error = "Should not check runtime info against " + to_string(mat.mType)
+                    + " compatibility matrix.";
+        }
+        return false;
+    }
+    if (kernelSepolicyVersion() != mat.framework.mSepolicy.kernelSepolicyVersion()) {
+        if (error != nullptr) {
+            *error = "kernelSepolicyVersion = " + to_string(kernelSepolicyVersion())
+                     + " but required " + to_string(mat.framework.mSepolicy.kernelSepolicyVersion());
+        }
+        return false;
+    }
+
+    // mat.mSepolicy.sepolicyVersion() is checked against static
+    // HalManifest.device.mSepolicyVersion in HalManifest::checkCompatibility.
+
+    const KernelRequirementTable* kernelRequirements = mat.mKernelRequirements.get();
+    if (kernelRequirements != nullptr ? !kernelRequirements->match(*this, error)
+                                      : !matchKernels(mat.framework.mKernels, error)) {
+        return false;
+    }
     if (error != nullptr) {
         error->clear();
     }
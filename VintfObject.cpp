@@ -20,73 +20,274 @@
 #include "parse_xml.h"
 #include "utils.h"
 
+#include <atomic>
 #include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <utility>
 
 namespace android {
 namespace vintf {
 
+// A cached object, together with whether it has been returned as a raw pointer. Such
+// an object is never freed: when it is superseded it is retired instead, because callers
+// of the raw getters have no way to say when they are done with it. Objects that were
+// only returned as std::shared_ptr are freed when the last caller releases them.
 template <typename T>
-struct LockedUniquePtr {
-    std::unique_ptr<T> object;
+struct Published {
+    Published() = default;
+    explicit Published(const T& other) : object(other) {}
+
+    T object;
+    std::atomic<bool> exposed{false};
+};
+
+template <typename T, typename... Args>
+static std::shared_ptr<Published<T>> MakePublished(Args&&... args) {
+    return std::shared_ptr<Published<T>>(
+        new Published<T>(std::forward<Args>(args)...), [](Published<T>* published) {
+            if (!published->exposed.load(std::memory_order_acquire)) {
+                delete published;
+            }
+        });
+}
+
+template <typename T>
+static std::shared_ptr<const T> Shared(const std::shared_ptr<Published<T>>& published) {
+    if (published == nullptr) {
+        return nullptr;
+    }
+    return std::shared_ptr<const T>(published, &published->object);
+}
+
+template <typename T>
+static const T* Expose(const std::shared_ptr<Published<T>>& published) {
+    if (published == nullptr) {
+        return nullptr;
+    }
+    published->exposed.store(true, std::memory_order_release);
+    return &published->object;
+}
+
+template <typename T>
+struct LockedSharedPtr {
+    // Only written with mutex held; always read and written with std::atomic_load /
+    // std::atomic_store so that readers can skip the mutex.
+    std::shared_ptr<Published<T>> object;
     std::mutex mutex;
+    // Signature of the file that object was read from. Only accessed with mutex held.
+    details::FileSignature signature;
+    bool hasSignature = false;
 };
 
-static LockedUniquePtr<HalManifest> gDeviceManifest;
-static LockedUniquePtr<HalManifest> gFrameworkManifest;
-static LockedUniquePtr<CompatibilityMatrix> gDeviceMatrix;
-static LockedUniquePtr<CompatibilityMatrix> gFrameworkMatrix;
-static LockedUniquePtr<RuntimeInfo> gDeviceRuntimeInfo;
+static LockedSharedPtr<HalManifest> gDeviceManifest;
+static LockedSharedPtr<HalManifest> gFrameworkManifest;
+static LockedSharedPtr<CompatibilityMatrix> gDeviceMatrix;
+static LockedSharedPtr<CompatibilityMatrix> gFrameworkMatrix;
+static LockedSharedPtr<RuntimeInfo> gDeviceRuntimeInfo;
+// Only written with gVintfSnapshotMutex held, which also serializes refreshes; always
+// read and written with std::atomic_load / std::atomic_store.
+static std::shared_ptr<const VintfSnapshot> gVintfSnapshot;
+static std::mutex gVintfSnapshotMutex;
+static ParsedXmlCache gParsedXmlCache;
+
+enum class FetchMode {
+    // Return the cached object if there is one.
+    CACHED,
+    // Always read the file again.
+    SKIP_CACHE,
+    // Return the cached object if the file has not changed since it was read.
+    VALIDATE_CACHE,
+};
 
 template <typename T, typename F>
-static const T *Get(
-        LockedUniquePtr<T> *ptr,
-        bool skipCache,
-        const F &fetchAllInformation) {
+static std::shared_ptr<Published<T>> Get(LockedSharedPtr<T>* ptr, FetchMode mode,
+                                         const std::string& path, const F& fetchAllInformation) {
+    // A published object is never modified, so the common case only needs to load the pointer.
+    if (mode == FetchMode::CACHED) {
+        std::shared_ptr<Published<T>> object = std::atomic_load(&ptr->object);
+        if (object != nullptr) {
+            return object;
+        }
+    }
+
     std::unique_lock<std::mutex> _lock(ptr->mutex);
-    if (skipCache || ptr->object == nullptr) {
-        ptr->object = std::make_unique<T>();
-        if (fetchAllInformation(ptr->object.get()) != OK) {
-            ptr->object = nullptr; // frees the old object
+    if (mode == FetchMode::CACHED) {
+        // Another thread may have published the object while this one was waiting.
+        std::shared_ptr<Published<T>> object = std::atomic_load(&ptr->object);
+        if (object != nullptr) {
+            return object;
+        }
+    }
+    // Take the signature before reading, so that a change while reading is seen next time.
+    details::FileSignature signature;
+    bool hasSignature = details::gFetcher != nullptr &&
+                        details::gFetcher->signature(path, &signature) == OK;
+    if (mode == FetchMode::VALIDATE_CACHE && hasSignature && ptr->hasSignature &&
+        signature == ptr->signature) {
+        std::shared_ptr<Published<T>> object = std::atomic_load(&ptr->object);
+        if (object != nullptr) {
+            return object;
         }
     }
-    return ptr->object.get();
+    std::shared_ptr<Published<T>> object = MakePublished<T>();
+    if (fetchAllInformation(&object->object, path) != OK) {
+        object = nullptr;
+    }
+    ptr->signature = signature;
+    ptr->hasSignature = hasSignature;
+    // The old object is freed or retired when the last caller holding it releases it.
+    std::atomic_store(&ptr->object, object);
+    return object;
+}
+
+// Return the cached object if the file has not changed since it was read, without
+// reading it. Return nullptr if it has to be read again.
+template <typename T>
+static std::shared_ptr<const T> GetIfUnchanged(LockedSharedPtr<T>* ptr, const std::string& path) {
+    std::unique_lock<std::mutex> _lock(ptr->mutex);
+    details::FileSignature signature;
+    if (!ptr->hasSignature || details::gFetcher == nullptr ||
+        details::gFetcher->signature(path, &signature) != OK || signature != ptr->signature) {
+        return nullptr;
+    }
+    return Shared(std::atomic_load(&ptr->object));
+}
+
+static FetchMode fetchMode(bool skipCache) {
+    return skipCache ? FetchMode::SKIP_CACHE : FetchMode::CACHED;
+}
+
+template <typename F>
+static std::shared_ptr<Published<RuntimeInfo>> GetDeviceRuntimeInfo(
+        bool skipCache, RuntimeInfo::FetchFlags flags, const F& fetchAllInformation) {
+    if (!skipCache) {
+        std::shared_ptr<Published<RuntimeInfo>> object =
+                std::atomic_load(&gDeviceRuntimeInfo.object);
+        if (object != nullptr && (object->object.fetchedFlags() & flags) == flags) {
+            return object;
+        }
+    }
+
+    std::unique_lock<std::mutex> _lock(gDeviceRuntimeInfo.mutex);
+    std::shared_ptr<Published<RuntimeInfo>> object;
+    if (!skipCache) {
+        std::shared_ptr<Published<RuntimeInfo>> cached =
+                std::atomic_load(&gDeviceRuntimeInfo.object);
+        if (cached != nullptr && (cached->object.fetchedFlags() & flags) == flags) {
+            return cached;
+        }
+        // Published objects are never modified, so fill in the missing parts on a copy.
+        if (cached != nullptr) {
+            object = MakePublished<RuntimeInfo>(cached->object);
+            flags &= ~cached->object.fetchedFlags();
+        }
+    }
+    if (object == nullptr) {
+        object = MakePublished<RuntimeInfo>();
+    }
+    if (fetchAllInformation(&object->object, flags, true /* parallel */) != OK) {
+        object = nullptr;
+    }
+    std::atomic_store(&gDeviceRuntimeInfo.object, object);
+    return object;
 }
 
 // static
 const HalManifest *VintfObject::GetDeviceHalManifest(bool skipCache) {
-    return Get(&gDeviceManifest, skipCache,
-            std::bind(&HalManifest::fetchAllInformation, std::placeholders::_1,
-                "/vendor/manifest.xml"));
+    return Expose(Get(&gDeviceManifest, fetchMode(skipCache), "/vendor/manifest.xml",
+            std::mem_fn(&HalManifest::fetchAllInformation)));
 }
 
 // static
 const HalManifest *VintfObject::GetFrameworkHalManifest(bool skipCache) {
-    return Get(&gFrameworkManifest, skipCache,
-            std::bind(&HalManifest::fetchAllInformation, std::placeholders::_1,
-                "/system/manifest.xml"));
+    return Expose(Get(&gFrameworkManifest, fetchMode(skipCache), "/system/manifest.xml",
+            std::mem_fn(&HalManifest::fetchAllInformation)));
 }
 
-
 // static
 const CompatibilityMatrix *VintfObject::GetDeviceCompatibilityMatrix(bool skipCache) {
-    return Get(&gDeviceMatrix, skipCache,
-            std::bind(&CompatibilityMatrix::fetchAllInformation, std::placeholders::_1,
-                "/vendor/compatibility_matrix.xml"));
+    return Expose(Get(&gDeviceMatrix, fetchMode(skipCache), "/vendor/compatibility_matrix.xml",
+            std::mem_fn(&CompatibilityMatrix::fetchAllInformation)));
 }
 
 // static
 const CompatibilityMatrix *VintfObject::GetFrameworkCompatibilityMatrix(bool skipCache) {
-    return Get(&gFrameworkMatrix, skipCache,
-            std::bind(&CompatibilityMatrix::fetchAllInformation, std::placeholders::_1,
-                "/system/compatibility_matrix.xml"));
+    return Expose(Get(&gFrameworkMatrix, fetchMode(skipCache), "/system/compatibility_matrix.xml",
+            std::mem_fn(&CompatibilityMatrix::fetchAllInformation)));
 }
 
 // static
 const RuntimeInfo *VintfObject::GetRuntimeInfo(bool skipCache) {
-    return Get(&gDeviceRuntimeInfo, skipCache,
-            std::bind(&RuntimeInfo::fetchAllInformation, std::placeholders::_1));
+    return Expose(GetDeviceRuntimeInfo(skipCache, RuntimeInfo::ALL,
+            std::mem_fn(&RuntimeInfo::fetchAllInformation)));
+}
+
+// static
+const RuntimeInfo *VintfObject::GetRuntimeInfo(bool skipCache, RuntimeInfo::FetchFlags flags) {
+    return Expose(GetDeviceRuntimeInfo(skipCache, flags,
+            std::mem_fn(&RuntimeInfo::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const HalManifest> VintfObject::GetSharedDeviceHalManifest(bool skipCache) {
+    return Shared(Get(&gDeviceManifest, fetchMode(skipCache), "/vendor/manifest.xml",
+            std::mem_fn(&HalManifest::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const HalManifest> VintfObject::GetSharedFrameworkHalManifest(bool skipCache) {
+    return Shared(Get(&gFrameworkManifest, fetchMode(skipCache), "/system/manifest.xml",
+            std::mem_fn(&HalManifest::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const CompatibilityMatrix> VintfObject::GetSharedDeviceCompatibilityMatrix(
+        bool skipCache) {
+    return Shared(Get(&gDeviceMatrix, fetchMode(skipCache), "/vendor/compatibility_matrix.xml",
+            std::mem_fn(&CompatibilityMatrix::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const CompatibilityMatrix> VintfObject::GetSharedFrameworkCompatibilityMatrix(
+        bool skipCache) {
+    return Shared(Get(&gFrameworkMatrix, fetchMode(skipCache), "/system/compatibility_matrix.xml",
+            std::mem_fn(&CompatibilityMatrix::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const RuntimeInfo> VintfObject::GetSharedRuntimeInfo(
+        bool skipCache, RuntimeInfo::FetchFlags flags) {
+    return Shared(GetDeviceRuntimeInfo(skipCache, flags,
+            std::mem_fn(&RuntimeInfo::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const HalManifest> VintfObject::GetDeviceHalManifestIfChanged() {
+    return Shared(Get(&gDeviceManifest, FetchMode::VALIDATE_CACHE, "/vendor/manifest.xml",
+            std::mem_fn(&HalManifest::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const HalManifest> VintfObject::GetFrameworkHalManifestIfChanged() {
+    return Shared(Get(&gFrameworkManifest, FetchMode::VALIDATE_CACHE, "/system/manifest.xml",
+            std::mem_fn(&HalManifest::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const CompatibilityMatrix> VintfObject::GetDeviceCompatibilityMatrixIfChanged() {
+    return Shared(Get(&gDeviceMatrix, FetchMode::VALIDATE_CACHE, "/vendor/compatibility_matrix.xml",
+            std::mem_fn(&CompatibilityMatrix::fetchAllInformation)));
+}
+
+// static
+std::shared_ptr<const CompatibilityMatrix>
+VintfObject::GetFrameworkCompatibilityMatrixIfChanged() {
+    return Shared(Get(&gFrameworkMatrix, FetchMode::VALIDATE_CACHE,
+            "/system/compatibility_matrix.xml",
+            std::mem_fn(&CompatibilityMatrix::fetchAllInformation)));
 }
 
 namespace details {
@@ -109,12 +310,8 @@ static std::string toString(ParseStatus status) {
 }
 
 template<typename T>
-static ParseStatus tryParse(const std::string &xml, const XmlConverter<T> &parse,
-        std::unique_ptr<T> *fwk, std::unique_ptr<T> *dev) {
-    std::unique_ptr<T> ret = std::make_unique<T>();
-    if (!parse(ret.get(), xml)) {
-        return ParseStatus::PARSE_ERROR;
-    }
+static ParseStatus addParsed(std::shared_ptr<T> ret, std::shared_ptr<T> *fwk,
+        std::shared_ptr<T> *dev) {
     if (ret->type() == SchemaType::FRAMEWORK) {
         if (fwk->get() != nullptr) {
             return ParseStatus::DUPLICATED_FWK_ENTRY;
@@ -129,10 +326,22 @@ static ParseStatus tryParse(const std::string &xml, const XmlConverter<T> &parse
     return ParseStatus::OK;
 }
 
+struct ParsedXml {
+    std::shared_ptr<const HalManifest>         manifest;
+    std::shared_ptr<const CompatibilityMatrix> matrix;
+};
+
+// Parse xml as a manifest or as a matrix, or reuse the objects parsed from it before.
+static ParsedXml parseXml(const std::string &xml) {
+    ParsedXml parsed;
+    VintfObject::GetParsedXmlCache().parse(xml, &parsed.manifest, &parsed.matrix);
+    return parsed;
+}
+
 template<typename T, typename GetFunction>
-static status_t getMissing(const T *pkg, bool mount,
+static status_t getMissing(const std::shared_ptr<const T>& pkg, bool mount,
         std::function<status_t(void)> mountFunction,
-        const T **updated,
+        std::shared_ptr<const T>* updated,
         GetFunction getFunction) {
     if (pkg != nullptr) {
         *updated = pkg;
@@ -152,8 +361,8 @@ static status_t getMissing(const T *pkg, bool mount,
 
 struct PackageInfo {
     struct Pair {
-        std::unique_ptr<HalManifest>         manifest;
-        std::unique_ptr<CompatibilityMatrix> matrix;
+        std::shared_ptr<const HalManifest>         manifest;
+        std::shared_ptr<const CompatibilityMatrix> matrix;
     };
     Pair dev;
     Pair fwk;
@@ -161,45 +370,65 @@ struct PackageInfo {
 
 struct UpdatedInfo {
     struct Pair {
-        const HalManifest         *manifest;
-        const CompatibilityMatrix *matrix;
+        std::shared_ptr<const HalManifest>         manifest;
+        std::shared_ptr<const CompatibilityMatrix> matrix;
     };
     Pair dev;
     Pair fwk;
-    const RuntimeInfo *runtimeInfo;
+    std::shared_ptr<const RuntimeInfo> runtimeInfo;
 };
 
+// Parse all information from package. If parallel, the XMLs are parsed concurrently.
+static status_t parsePackage(const std::vector<std::string>& xmls, PackageInfo* pkg,
+                             std::string* error, bool parallel) {
+    std::vector<ParsedXml> parsed(xmls.size());
+    std::vector<std::future<ParsedXml>> futures;
+    for (size_t i = 1; parallel && i < xmls.size(); ++i) {
+        futures.push_back(std::async(std::launch::async, parseXml, std::cref(xmls[i])));
+    }
+    for (size_t i = 0; i < xmls.size(); ++i) {
+        parsed[i] = (i == 0 || !parallel) ? parseXml(xmls[i]) : futures[i - 1].get();
+    }
+
+    // Look for duplicates in the order of xmls, so the reported error is deterministic.
+    ParseStatus parseStatus;
+    for (ParsedXml& xml : parsed) {
+        if (xml.manifest != nullptr) {
+            parseStatus = addParsed(std::move(xml.manifest), &pkg->fwk.manifest,
+                                    &pkg->dev.manifest);
+            if (parseStatus != ParseStatus::OK) {
+                ADD_MESSAGE(toString(parseStatus) + " manifest");
+                return ALREADY_EXISTS;
+            }
+        } else if (xml.matrix != nullptr) {
+            parseStatus = addParsed(std::move(xml.matrix), &pkg->fwk.matrix, &pkg->dev.matrix);
+            if (parseStatus != ParseStatus::OK) {
+                ADD_MESSAGE(toString(parseStatus) + " matrix");
+                return ALREADY_EXISTS;
+            }
+        } else {
+            ADD_MESSAGE(toString(ParseStatus::PARSE_ERROR));
+            return BAD_VALUE;
+        }
+    }
+    return OK;
+}
+
+static int32_t checkUpdated(const UpdatedInfo& updated, std::string* error,
+                            DisabledChecks disabledChecks, CheckResultCache* cache);
+
 // Checks given compatibility info against info on the device. If no
 // compatability info is given then the device info will be checked against
 // itself.
 int32_t checkCompatibility(const std::vector<std::string>& xmls, bool mount,
                            const PartitionMounter& mounter, std::string* error,
-                           DisabledChecks disabledChecks) {
+                           DisabledChecks disabledChecks, CheckResultCache* cache) {
     status_t status;
-    ParseStatus parseStatus;
     PackageInfo pkg; // All information from package.
     UpdatedInfo updated; // All files and runtime info after the update.
 
-    // parse all information from package
-    for (const auto &xml : xmls) {
-        parseStatus = tryParse(xml, gHalManifestConverter, &pkg.fwk.manifest, &pkg.dev.manifest);
-        if (parseStatus == ParseStatus::OK) {
-            continue; // work on next one
-        }
-        if (parseStatus != ParseStatus::PARSE_ERROR) {
-            ADD_MESSAGE(toString(parseStatus) + " manifest");
-            return ALREADY_EXISTS;
-        }
-        parseStatus = tryParse(xml, gCompatibilityMatrixConverter, &pkg.fwk.matrix, &pkg.dev.matrix);
-        if (parseStatus == ParseStatus::OK) {
-            continue; // work on next one
-        }
-        if (parseStatus != ParseStatus::PARSE_ERROR) {
-            ADD_MESSAGE(toString(parseStatus) + " matrix");
-            return ALREADY_EXISTS;
-        }
-        ADD_MESSAGE(toString(parseStatus)); // parse error
-        return BAD_VALUE;
+    if ((status = parsePackage(xmls, &pkg, error, true /* parallel */)) != OK) {
+        return status;
     }
 
     // get missing info from device
@@ -207,24 +436,24 @@ int32_t checkCompatibility(const std::vector<std::string>& xmls, bool mount,
     auto mountSystem = [&mounter] { return mounter.mountSystem(); };
     auto mountVendor = [&mounter] { return mounter.mountVendor(); };
     if ((status = getMissing(
-             pkg.fwk.manifest.get(), mount, mountSystem, &updated.fwk.manifest,
-             std::bind(VintfObject::GetFrameworkHalManifest, true /* skipCache */))) != OK) {
+             pkg.fwk.manifest, mount, mountSystem, &updated.fwk.manifest,
+             VintfObject::GetFrameworkHalManifestIfChanged)) != OK) {
         return status;
     }
     if ((status = getMissing(
-             pkg.dev.manifest.get(), mount, mountVendor, &updated.dev.manifest,
-             std::bind(VintfObject::GetDeviceHalManifest, true /* skipCache */))) != OK) {
+             pkg.dev.manifest, mount, mountVendor, &updated.dev.manifest,
+             VintfObject::GetDeviceHalManifestIfChanged)) != OK) {
         return status;
     }
     if ((status = getMissing(
-             pkg.fwk.matrix.get(), mount, mountSystem, &updated.fwk.matrix,
-             std::bind(VintfObject::GetFrameworkCompatibilityMatrix, true /* skipCache */))) !=
+             pkg.fwk.matrix, mount, mountSystem, &updated.fwk.matrix,
+             VintfObject::GetFrameworkCompatibilityMatrixIfChanged)) !=
         OK) {
         return status;
     }
     if ((status = getMissing(
-             pkg.dev.matrix.get(), mount, mountVendor, &updated.dev.matrix,
-             std::bind(VintfObject::GetDeviceCompatibilityMatrix, true /* skipCache */))) != OK) {
+             pkg.dev.matrix, mount, mountVendor, &updated.dev.matrix,
+             VintfObject::GetDeviceCompatibilityMatrixIfChanged)) != OK) {
         return status;
     }
 
@@ -233,8 +462,28 @@ int32_t checkCompatibility(const std::vector<std::string>& xmls, bool mount,
         (void)mounter.umountVendor(); // ignore errors
     }
 
-    updated.runtimeInfo = VintfObject::GetRuntimeInfo(true /* skipCache */);
+    // The kernel and boot properties do not change until reboot, so the cached runtime info
+    // is always valid. /proc/cpuinfo is not checked.
+    updated.runtimeInfo = VintfObject::GetSharedRuntimeInfo(false /* skipCache */,
+                                                      RuntimeInfo::ALL & ~RuntimeInfo::CPU_INFO);
+
+    return checkUpdated(updated, error, disabledChecks, cache);
+}
 
+// Run one check of checkUpdated, or reuse its result from cache.
+static bool runCheck(CheckResultCache* cache, UpdateCheck check,
+                     const std::shared_ptr<const void>& first,
+                     const std::shared_ptr<const void>& second, DisabledChecks disabledChecks,
+                     std::string* error, const std::function<bool(std::string*)>& run) {
+    if (cache == nullptr) {
+        return run(error);
+    }
+    return cache->check(check, first, second, disabledChecks, error, run);
+}
+
+// Checks all files and runtime info after the update against each other.
+static int32_t checkUpdated(const UpdatedInfo& updated, std::string* error,
+                            DisabledChecks disabledChecks, CheckResultCache* cache) {
     // null checks for files and runtime info after the update
     // TODO(b/37321309) if a compat mat is missing, it is not matched and considered compatible.
     if (updated.fwk.manifest == nullptr) {
@@ -260,36 +509,77 @@ int32_t checkCompatibility(const std::vector<std::string>& xmls, bool mount,
 
     // compatiblity check.
     // TODO(b/37321309) outer if checks can be removed if we consider missing matrices as errors.
+    std::string checkError;
     if (updated.dev.manifest && updated.fwk.matrix) {
-        if (!updated.dev.manifest->checkCompatibility(*updated.fwk.matrix, error)) {
+        if (!runCheck(cache, UpdateCheck::DEVICE_MANIFEST, updated.dev.manifest,
+                      updated.fwk.matrix, ENABLE_ALL_CHECKS, &checkError,
+                      [&updated](std::string* e) {
+                          return updated.dev.manifest->checkCompatibility(*updated.fwk.matrix, e);
+                      })) {
             if (error)
-                error->insert(0, "Device manifest and framework compatibility matrix "
-                                 "are incompatible: ");
+                *error = "Device manifest and framework compatibility matrix "
+                         "are incompatible: " + checkError;
             return INCOMPATIBLE;
         }
     }
     if (updated.fwk.manifest && updated.dev.matrix) {
-        if (!updated.fwk.manifest->checkCompatibility(*updated.dev.matrix, error)) {
+        if (!runCheck(cache, UpdateCheck::FRAMEWORK_MANIFEST, updated.fwk.manifest,
+                      updated.dev.matrix, ENABLE_ALL_CHECKS, &checkError,
+                      [&updated](std::string* e) {
+                          return updated.fwk.manifest->checkCompatibility(*updated.dev.matrix, e);
+                      })) {
             if (error)
-                error->insert(0, "Framework manifest and device compatibility matrix "
-                                 "are incompatible: ");
+                *error = "Framework manifest and device compatibility matrix "
+                         "are incompatible: " + checkError;
             return INCOMPATIBLE;
         }
     }
     if (updated.runtimeInfo && updated.fwk.matrix) {
-        if (!updated.runtimeInfo->checkCompatibility(*updated.fwk.matrix, error, disabledChecks)) {
+        if (!runCheck(cache, UpdateCheck::RUNTIME_INFO, updated.runtimeInfo, updated.fwk.matrix,
+                      disabledChecks, &checkError, [&updated, disabledChecks](std::string* e) {
+                          return updated.runtimeInfo->checkCompatibility(*updated.fwk.matrix, e,
+                                                                         disabledChecks);
+                      })) {
             if (error)
-                error->insert(0, "Runtime info and framework compatibility matrix "
-                                 "are incompatible: ");
+                *error = "Runtime info and framework compatibility matrix "
+                         "are incompatible: " + checkError;
             return INCOMPATIBLE;
         }
+        // RuntimeInfo::checkCompatibility clears the error when it succeeds.
+        if (error)
+            error->clear();
     }
 
     return COMPATIBLE;
 }
 
+static CompatibilityResult checkPackage(const DeviceSnapshot& device,
+                                        const std::vector<std::string>& xmls,
+                                        DisabledChecks disabledChecks) {
+    CompatibilityResult result;
+    std::string* error = &result.error;
+    PackageInfo pkg;
+    // Packages are already checked in parallel.
+    if ((result.status = parsePackage(xmls, &pkg, error, false /* parallel */)) != OK) {
+        return result;
+    }
+    UpdatedInfo updated;
+    updated.fwk.manifest = pkg.fwk.manifest ? pkg.fwk.manifest : device.frameworkManifest;
+    updated.dev.manifest = pkg.dev.manifest ? pkg.dev.manifest : device.deviceManifest;
+    updated.fwk.matrix = pkg.fwk.matrix ? pkg.fwk.matrix : device.frameworkMatrix;
+    updated.dev.matrix = pkg.dev.matrix ? pkg.dev.matrix : device.deviceMatrix;
+    updated.runtimeInfo = device.runtimeInfo;
+    result.status = checkUpdated(updated, error, disabledChecks, nullptr /* cache */);
+    return result;
+}
+
 } // namespace details
 
+// static
+ParsedXmlCache& VintfObject::GetParsedXmlCache() {
+    return gParsedXmlCache;
+}
+
 // static
 int32_t VintfObject::CheckCompatibility(const std::vector<std::string>& xmls, std::string* error,
                                         DisabledChecks disabledChecks) {
@@ -297,6 +587,111 @@ int32_t VintfObject::CheckCompatibility(const std::vector<std::string>& xmls, st
                                        disabledChecks);
 }
 
+// static
+DeviceSnapshot VintfObject::GetDeviceSnapshot() {
+    // /proc/cpuinfo is not checked.
+    return LoadDeviceSnapshot(RuntimeInfo::ALL & ~RuntimeInfo::CPU_INFO);
+}
+
+// static
+DeviceSnapshot VintfObject::LoadDeviceSnapshot(RuntimeInfo::FetchFlags runtimeInfoFlags) {
+    DeviceSnapshot device;
+
+    // Usually no file has changed, which only costs a stat() each. Files that have to be
+    // read again have their own locks, so they are read concurrently with the runtime info:
+    // all but the first one on other threads, then the runtime info and the first one on
+    // this thread.
+    std::vector<std::function<void()>> reads;
+    if ((device.deviceManifest = GetIfUnchanged(&gDeviceManifest, "/vendor/manifest.xml")) ==
+        nullptr) {
+        reads.push_back([&] { device.deviceManifest = GetDeviceHalManifestIfChanged(); });
+    }
+    if ((device.frameworkManifest = GetIfUnchanged(&gFrameworkManifest, "/system/manifest.xml")) ==
+        nullptr) {
+        reads.push_back([&] { device.frameworkManifest = GetFrameworkHalManifestIfChanged(); });
+    }
+    if ((device.deviceMatrix = GetIfUnchanged(&gDeviceMatrix,
+                                              "/vendor/compatibility_matrix.xml")) == nullptr) {
+        reads.push_back([&] { device.deviceMatrix = GetDeviceCompatibilityMatrixIfChanged(); });
+    }
+    if ((device.frameworkMatrix = GetIfUnchanged(&gFrameworkMatrix,
+                                                 "/system/compatibility_matrix.xml")) == nullptr) {
+        reads.push_back(
+            [&] { device.frameworkMatrix = GetFrameworkCompatibilityMatrixIfChanged(); });
+    }
+    std::vector<std::future<void>> futures;
+    for (size_t i = 1; i < reads.size(); ++i) {
+        futures.push_back(std::async(std::launch::async, reads[i]));
+    }
+    device.runtimeInfo = GetSharedRuntimeInfo(false /* skipCache */, runtimeInfoFlags);
+    if (!reads.empty()) {
+        reads[0]();
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+    return device;
+}
+
+static bool sameParts(const DeviceSnapshot& a, const DeviceSnapshot& b) {
+    return a.deviceManifest == b.deviceManifest && a.frameworkManifest == b.frameworkManifest &&
+           a.deviceMatrix == b.deviceMatrix && a.frameworkMatrix == b.frameworkMatrix &&
+           a.runtimeInfo == b.runtimeInfo;
+}
+
+// static
+std::shared_ptr<const VintfSnapshot> VintfObject::GetVintfSnapshot(bool refresh) {
+    if (!refresh) {
+        std::shared_ptr<const VintfSnapshot> snapshot = std::atomic_load(&gVintfSnapshot);
+        if (snapshot != nullptr) {
+            return snapshot;
+        }
+    }
+
+    std::unique_lock<std::mutex> _lock(gVintfSnapshotMutex);
+    std::shared_ptr<const VintfSnapshot> current = std::atomic_load(&gVintfSnapshot);
+    if (!refresh && current != nullptr) {
+        return current;
+    }
+    DeviceSnapshot device = LoadDeviceSnapshot(RuntimeInfo::ALL);
+    if (current != nullptr && sameParts(current->device(), device)) {
+        return current;
+    }
+    uint64_t version = current == nullptr ? 1 : current->version() + 1;
+    std::shared_ptr<const VintfSnapshot> snapshot(new VintfSnapshot(version, std::move(device)));
+    // Readers holding the old snapshot keep it until they release it.
+    std::atomic_store(&gVintfSnapshot, snapshot);
+    return snapshot;
+}
+
+// static
+std::vector<CompatibilityResult> VintfObject::CheckCompatibility(
+        const DeviceSnapshot& device, const std::vector<std::vector<std::string>>& packages,
+        DisabledChecks disabledChecks, size_t numThreads) {
+    std::vector<CompatibilityResult> results(packages.size());
+    // Objects in device are never modified, so they can be shared by all threads.
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next++) < packages.size();) {
+            results[i] = details::checkPackage(device, packages[i], disabledChecks);
+        }
+    };
+
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    numThreads = std::min(numThreads, packages.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
 
 } // namespace vintf
 } // namespace android
@@ -19,7 +19,9 @@
 #include <unistd.h>
 
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <unordered_map>
 #include <sstream>
 #include <string>
@@ -27,6 +29,7 @@
 #include <android-base/file.h>
 
 #include <vintf/KernelConfigParser.h>
+#include <vintf/parse_binary.h>
 #include <vintf/parse_string.h>
 #include <vintf/parse_xml.h>
 
@@ -64,9 +67,7 @@ class AssembleVintf {
     }
 
     static std::string read(std::basic_istream<char>& is) {
-        std::stringstream ss;
-        ss << is.rdbuf();
-        return ss.str();
+        return std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
     }
 
     static bool isCommonConfig(const std::string& path) {
@@ -177,6 +178,30 @@ class AssembleVintf {
         return mOutFileRef == nullptr ? std::cout : *mOutFileRef;
     }
 
+    // Write a binary image of xml, which has just been written to out(), if requested.
+    template <typename Schema>
+    bool writeBinaryImage(const XmlConverter<Schema>& converter,
+                          const BinaryConverter<Schema>& binaryConverter, const std::string& xml) {
+        if (mBinaryFileRef == nullptr) {
+            return true;
+        }
+        // Compile from the output rather than the in-memory object, so that the
+        // image decodes to exactly what parsing the output file gives.
+        Schema schema;
+        if (!converter(&schema, xml)) {
+            std::cerr << "Cannot parse output to write binary image: " << converter.lastError()
+                      << std::endl;
+            return false;
+        }
+        *mBinaryFileRef << binaryConverter.serialize(schema, xml);
+        mBinaryFileRef->flush();
+        if (!mBinaryFileRef->good()) {
+            std::cerr << "Cannot write binary image." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
     bool assembleHalManifest(HalManifest* halManifest) {
         std::string error;
 
@@ -192,18 +217,29 @@ class AssembleVintf {
                 std::cerr << "FATAL ERROR: cannot generate a compatible matrix: " << error
                           << std::endl;
             }
-            out() << "<!-- \n"
-                     "    Autogenerated skeleton compatibility matrix. \n"
-                     "    Use with caution. Modify it to suit your needs.\n"
-                     "    All HALs are set to optional.\n"
-                     "    Many entries other than HALs are zero-filled and\n"
-                     "    require human attention. \n"
-                     "-->\n"
-                  << gCompatibilityMatrixConverter(generatedMatrix);
+            std::string xml =
+                "<!-- \n"
+                "    Autogenerated skeleton compatibility matrix. \n"
+                "    Use with caution. Modify it to suit your needs.\n"
+                "    All HALs are set to optional.\n"
+                "    Many entries other than HALs are zero-filled and\n"
+                "    require human attention. \n"
+                "-->\n";
+            gCompatibilityMatrixConverter.serialize(generatedMatrix, &xml);
+            out() << xml;
+            out().flush();
+            if (!writeBinaryImage(gCompatibilityMatrixConverter,
+                                  gCompatibilityMatrixBinaryConverter, xml)) {
+                return false;
+            }
         } else {
-            out() << gHalManifestConverter(*halManifest);
+            std::string xml = gHalManifestConverter(*halManifest);
+            out() << xml;
+            out().flush();
+            if (!writeBinaryImage(gHalManifestConverter, gHalManifestBinaryConverter, xml)) {
+                return false;
+            }
         }
-        out().flush();
 
         if (mCheckFile.is_open()) {
             CompatibilityMatrix checkMatrix;
@@ -274,8 +310,13 @@ class AssembleVintf {
             }
             matrix->framework.mAvbMetaVersion = avbMetaVersion;
         }
-        out() << gCompatibilityMatrixConverter(*matrix);
+        std::string xml = gCompatibilityMatrixConverter(*matrix);
+        out() << xml;
         out().flush();
+        if (!writeBinaryImage(gCompatibilityMatrixConverter, gCompatibilityMatrixBinaryConverter,
+                              xml)) {
+            return false;
+        }
 
         if (mCheckFile.is_open()) {
             HalManifest checkManifest;
@@ -293,32 +334,57 @@ class AssembleVintf {
         return true;
     }
 
+    template <typename Schema>
+    struct ParsedFile {
+        Schema schema;
+        bool success;
+        std::string error;
+    };
+
+    template <typename Schema>
+    static ParsedFile<Schema> parseFile(const XmlConverter<Schema>* converter,
+                                        const std::string* content) {
+        ParsedFile<Schema> parsed;
+        parsed.success = (*converter)(&parsed.schema, *content);
+        if (!parsed.success) {
+            parsed.error = converter->lastError();
+        }
+        return parsed;
+    }
+
     enum AssembleStatus { SUCCESS, FAIL_AND_EXIT, TRY_NEXT };
     template <typename Schema, typename AssembleFunc>
     AssembleStatus tryAssemble(const XmlConverter<Schema>& converter, const std::string& schemaName,
                                AssembleFunc assemble) {
+        // The remaining files are parsed in parallel, and only if the first file
+        // has the right format.
         Schema schema;
-        if (!converter(&schema, read(mInFiles.front()))) {
+        if (!converter(&schema, mInFiles.front())) {
             return TRY_NEXT;
         }
-        auto firstType = schema.type();
+        std::vector<std::future<ParsedFile<Schema>>> additionalFiles;
         for (auto it = mInFiles.begin() + 1; it != mInFiles.end(); ++it) {
-            Schema additionalSchema;
-            if (!converter(&additionalSchema, read(*it))) {
-                std::cerr << "File \"" << mInFilePaths[std::distance(mInFiles.begin(), it)]
-                          << "\" is not a valid " << firstType << " " << schemaName
-                          << " (but the first file is a valid " << firstType << " " << schemaName
-                          << "). Error: " << converter.lastError() << std::endl;
+            additionalFiles.push_back(
+                std::async(std::launch::async, &parseFile<Schema>, &converter, &*it));
+        }
+
+        auto firstType = schema.type();
+        for (size_t i = 0; i < additionalFiles.size(); ++i) {
+            const std::string& path = mInFilePaths[i + 1];
+            ParsedFile<Schema> additional = additionalFiles[i].get();
+            if (!additional.success) {
+                std::cerr << "File \"" << path << "\" is not a valid " << firstType << " "
+                          << schemaName << " (but the first file is a valid " << firstType << " "
+                          << schemaName << "). Error: " << additional.error << std::endl;
                 return FAIL_AND_EXIT;
             }
-            if (additionalSchema.type() != firstType) {
-                std::cerr << "File \"" << mInFilePaths[std::distance(mInFiles.begin(), it)]
-                          << "\" is a " << additionalSchema.type() << " " << schemaName
-                          << " (but a " << firstType << " " << schemaName << " is expected)."
-                          << std::endl;
+            if (additional.schema.type() != firstType) {
+                std::cerr << "File \"" << path << "\" is a " << additional.schema.type() << " "
+                          << schemaName << " (but a " << firstType << " " << schemaName
+                          << " is expected)." << std::endl;
                 return FAIL_AND_EXIT;
             }
-            schema.addAll(std::move(additionalSchema));
+            schema.addAll(std::move(additional.schema));
         }
         return assemble(&schema) ? SUCCESS : FAIL_AND_EXIT;
     }
@@ -330,23 +396,35 @@ class AssembleVintf {
             return false;
         }
 
-        auto status = tryAssemble(gHalManifestConverter, "manifest",
-                                  std::bind(&AssembleVintf::assembleHalManifest, this, _1));
-        if (status == SUCCESS) return true;
-        if (status == FAIL_AND_EXIT) return false;
+        // The format is decided by the root element of the first file, so that a
+        // matrix is not parsed as a manifest first. Try both if it is unknown.
+        std::string root = getRootElementName(mInFiles.front());
 
-        resetInFiles();
+        AssembleStatus status = TRY_NEXT;
+        if (root != "compatibility-matrix") {
+            status = tryAssemble(gHalManifestConverter, "manifest",
+                                 std::bind(&AssembleVintf::assembleHalManifest, this, _1));
+            if (status == SUCCESS) return true;
+            if (status == FAIL_AND_EXIT) return false;
+        }
 
-        status = tryAssemble(gCompatibilityMatrixConverter, "compatibility matrix",
-                             std::bind(&AssembleVintf::assembleCompatibilityMatrix, this, _1));
-        if (status == SUCCESS) return true;
-        if (status == FAIL_AND_EXIT) return false;
+        if (root != "manifest") {
+            status = tryAssemble(gCompatibilityMatrixConverter, "compatibility matrix",
+                                 std::bind(&AssembleVintf::assembleCompatibilityMatrix, this, _1));
+            if (status == SUCCESS) return true;
+            if (status == FAIL_AND_EXIT) return false;
+        }
 
-        std::cerr << "Input file has unknown format." << std::endl
-                  << "Error when attempting to convert to manifest: "
-                  << gHalManifestConverter.lastError() << std::endl
-                  << "Error when attempting to convert to compatibility matrix: "
-                  << gCompatibilityMatrixConverter.lastError() << std::endl;
+        // Only report the errors of the converters that were tried.
+        std::cerr << "Input file has unknown format." << std::endl;
+        if (root != "compatibility-matrix") {
+            std::cerr << "Error when attempting to convert to manifest: "
+                      << gHalManifestConverter.lastError() << std::endl;
+        }
+        if (root != "manifest") {
+            std::cerr << "Error when attempting to convert to compatibility matrix: "
+                      << gCompatibilityMatrixConverter.lastError() << std::endl;
+        }
         return false;
     }
 
@@ -356,11 +434,17 @@ class AssembleVintf {
         return mOutFileRef->is_open();
     }
 
+    bool openBinaryFile(const char* path) {
+        mBinaryFileRef = std::make_unique<std::ofstream>();
+        mBinaryFileRef->open(path, std::ios::out | std::ios::binary);
+        return mBinaryFileRef->is_open();
+    }
+
+    // Each input file is read once, with a single read into a buffer of the file size.
     bool openInFile(const char* path) {
         mInFilePaths.push_back(path);
         mInFiles.push_back({});
-        mInFiles.back().open(path);
-        return mInFiles.back().is_open();
+        return ::android::base::ReadFileToString(path, &mInFiles.back());
     }
 
     bool openCheckFile(const char* path) {
@@ -368,13 +452,6 @@ class AssembleVintf {
         return mCheckFile.is_open();
     }
 
-    void resetInFiles() {
-        for (auto& inFile : mInFiles) {
-            inFile.clear();
-            inFile.seekg(0);
-        }
-    }
-
     void setOutputMatrix() { mOutputMatrix = true; }
 
     bool addKernel(const std::string& kernelArg) {
@@ -400,8 +477,9 @@ class AssembleVintf {
 
    private:
     std::vector<std::string> mInFilePaths;
-    std::vector<std::ifstream> mInFiles;
+    std::vector<std::string> mInFiles;  // contents of the files in mInFilePaths
     std::unique_ptr<std::ofstream> mOutFileRef;
+    std::unique_ptr<std::ofstream> mBinaryFileRef;
     std::ifstream mCheckFile;
     bool mOutputMatrix = false;
     std::map<Version, std::string> mKernels;
@@ -416,7 +494,7 @@ void help() {
                  "assemble_vintf -h\n"
                  "               Display this help text.\n"
                  "assemble_vintf -i <input file>[:<input file>[...]] [-o <output file>] [-m]\n"
-                 "               [-c [<check file>]]\n"
+                 "               [-c [<check file>]] [-b <binary image file>]\n"
                  "               Fill in build-time flags into the given file.\n"
                  "    -i <input file>[:<input file>[...]]\n"
                  "               A list of input files. Format is automatically detected for the\n"
@@ -425,6 +503,11 @@ void help() {
                  "               other entries are ignored.\n"
                  "    -o <output file>\n"
                  "               Optional output file. If not specified, write to stdout.\n"
+                 "    -b <binary image file>\n"
+                 "               Optional. Also write a binary image of the output file, which\n"
+                 "               libvintf loads instead of parsing the output file. Install it\n"
+                 "               next to the output file, with the name <output file>.bin.\n"
+                 "               The image is ignored if the content of the output file changes.\n"
                  "    -m\n"
                  "               a compatible compatibility matrix is\n"
                  "               generated instead; for example, given a device manifest,\n"
@@ -453,7 +536,7 @@ int main(int argc, char **argv) {
     ::android::vintf::AssembleVintf assembleVintf;
     int res;
     int optind;
-    while ((res = getopt_long(argc, argv, "hi:o:mc:", longopts, &optind)) >= 0) {
+    while ((res = getopt_long(argc, argv, "hi:o:mc:b:", longopts, &optind)) >= 0) {
         switch (res) {
             case 'i': {
                 char* inFilePath = strtok(optarg, ":");
@@ -474,6 +557,13 @@ int main(int argc, char **argv) {
                 }
             } break;
 
+            case 'b': {
+                if (!assembleVintf.openBinaryFile(optarg)) {
+                    std::cerr << "Failed to open " << optarg << std::endl;
+                    return 1;
+                }
+            } break;
+
             case 'm': {
                 assembleVintf.setOutputMatrix();
             } break;
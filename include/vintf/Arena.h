@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_ARENA_H
+#define ANDROID_VINTF_ARENA_H
+
+#include <stddef.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <vector>
+
+namespace android {
+namespace vintf {
+
+// Monotonic memory for the containers of a parsed object graph. Memory is handed out
+// from a few growing blocks and is only given back when the last container that uses
+// the arena is destroyed, so that freeing the graph frees a few blocks instead of
+// every node.
+// An arena is filled by a single thread while an ArenaScope is active. When the scope
+// ends, the arena is sealed: containers that grow afterwards allocate from the heap,
+// so that objects sharing an arena can still be modified on different threads.
+class Arena {
+   public:
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Return nullptr if the arena is sealed.
+    void* allocate(size_t size, size_t alignment);
+    // Return false if p was not allocated from the arena.
+    bool deallocate(void* p, size_t size);
+    inline void seal() { mSealed = true; }
+
+    // Number of blocks, for testing.
+    inline size_t numBlocks() const { return mBlocks.size(); }
+
+   private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    bool mSealed = false;
+    std::vector<Block> mBlocks;
+    // Bytes used in mBlocks.back().
+    size_t mUsed = 0;
+};
+
+// Makes containers with an ArenaAllocator that are constructed on this thread
+// allocate from a new arena until the scope ends, and then seals the arena. Scopes
+// may nest.
+class ArenaScope {
+   public:
+    ArenaScope();
+    ~ArenaScope();
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    inline const std::shared_ptr<Arena>& arena() const { return mArena; }
+
+    // The arena of the innermost scope on this thread, or nullptr if there is none.
+    static std::shared_ptr<Arena> current();
+
+   private:
+    std::shared_ptr<Arena> mArena;
+    ArenaScope* mPrevious;
+};
+
+// Allocates from the arena of the ArenaScope that was active when the container was
+// constructed, or from the heap if there was none. Moving a container keeps its
+// arena; copying it allocates from the current scope, like constructing a new one.
+template <typename T>
+class ArenaAllocator {
+   public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() : mArena(ArenaScope::current()) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : mArena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        void* p = mArena != nullptr ? mArena->allocate(n * sizeof(T), alignof(T)) : nullptr;
+        return static_cast<T*>(p != nullptr ? p : ::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        if (mArena == nullptr || !mArena->deallocate(p, n * sizeof(T))) {
+            ::operator delete(p);
+        }
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    inline const std::shared_ptr<Arena>& arena() const { return mArena; }
+
+   private:
+    std::shared_ptr<Arena> mArena;
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return !(a == b);
+}
+
+template <typename K, typename Compare = std::less<K>>
+using ArenaSet = std::set<K, Compare, ArenaAllocator<K>>;
+
+template <typename K, typename V, typename Compare = std::less<K>>
+using ArenaMap = std::map<K, V, Compare, ArenaAllocator<std::pair<const K, V>>>;
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_ARENA_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_COMPATIBILITY_CHECKER_H_
+#define ANDROID_VINTF_COMPATIBILITY_CHECKER_H_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "DisabledChecks.h"
+#include "VintfObject.h"
+
+namespace android {
+namespace vintf {
+
+/*
+ * Checks update packages against the device, like VintfObject::CheckCompatibility,
+ * but remembers the result of each check:
+ *   device manifest    vs. framework matrix
+ *   framework manifest vs. device matrix
+ *   runtime info       vs. framework matrix
+ * keyed by the two objects that were checked. Package XMLs are parsed through
+ * VintfObject::GetParsedXmlCache(), which returns the same object for the same XML
+ * while it is cached, and parts of the device come from the VintfObject caches. A
+ * check only runs again when one of its inputs changes, so checking many packages
+ * against the same device only runs the checks for the parts that each package
+ * replaces.
+ *
+ * At most capacity() results are remembered, evicted in least-recently-used order.
+ * A result keeps the objects it was computed from alive, so that their addresses
+ * are not reused by other objects.
+ *
+ * Checks run without holding any lock, so concurrent calls run concurrently.
+ * All operations are thread-safe.
+ */
+class CompatibilityChecker : private details::CheckResultCache {
+   public:
+    static constexpr size_t kDefaultCapacity = 64;
+
+    explicit CompatibilityChecker(size_t capacity = kDefaultCapacity);
+
+    // Same as VintfObject::CheckCompatibility.
+    int32_t checkCompatibility(const std::vector<std::string>& packageInfo,
+                               std::string* error = nullptr,
+                               DisabledChecks disabledChecks = ENABLE_ALL_CHECKS);
+
+    // Forget all remembered results.
+    void clear();
+    size_t capacity() const { return mCapacity; }
+
+   private:
+    using Key = std::tuple<details::UpdateCheck, const void*, const void*, DisabledChecks>;
+    struct Result {
+        Key key;
+        // Keep the checked objects alive while their addresses are in key.
+        std::shared_ptr<const void> first;
+        std::shared_ptr<const void> second;
+        bool compatible;
+        std::string error;
+    };
+    using Results = std::list<Result>;
+
+    bool check(details::UpdateCheck check, const std::shared_ptr<const void>& first,
+               const std::shared_ptr<const void>& second, DisabledChecks disabledChecks,
+               std::string* error, const std::function<bool(std::string*)>& run) override;
+
+    std::mutex mMutex;
+    const size_t mCapacity;
+    // Most recently used first.
+    Results mResults;
+    std::map<Key, Results::iterator> mIndex;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_COMPATIBILITY_CHECKER_H_
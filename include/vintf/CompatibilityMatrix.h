@@ -22,6 +22,7 @@
 
 #include <utils/Errors.h>
 
+#include "DerivedCache.h"
 #include "HalGroup.h"
 #include "MapValueIterator.h"
 #include "MatrixHal.h"
@@ -34,8 +35,12 @@
 namespace android {
 namespace vintf {
 
+class KernelRequirementTable;
+
 // Compatibility matrix defines what hardware does the framework requires.
-struct CompatibilityMatrix : public HalGroup<MatrixHal>, public XmlFileGroup<MatrixXmlFile> {
+struct CompatibilityMatrix
+    : public HalGroup<MatrixHal, SortedVectorMultiMap<InternedString, MatrixHal>>,
+      public XmlFileGroup<MatrixXmlFile> {
     // Create a framework compatibility matrix.
     CompatibilityMatrix() : mType(SchemaType::FRAMEWORK) {};
 
@@ -60,12 +65,20 @@ struct CompatibilityMatrix : public HalGroup<MatrixHal>, public XmlFileGroup<Mat
 
     status_t fetchAllInformation(const std::string &path);
 
+    // Build mKernelRequirements from framework.mKernels so that
+    // RuntimeInfo::checkCompatibility checks each kernel config requirement once.
+    // The kernels must not be modified afterwards.
+    void buildKernelRequirementTable();
+
     friend struct HalManifest;
     friend struct RuntimeInfo;
     friend struct CompatibilityMatrixConverter;
+    friend struct BinaryCodec;
     friend struct LibVintfTest;
+    friend struct LibVintfBenchmark;
     friend class VintfObject;
     friend class AssembleVintf;
+    friend class ParsedXmlCache;
     friend bool operator==(const CompatibilityMatrix &, const CompatibilityMatrix &);
 
     SchemaType mType;
@@ -81,6 +94,10 @@ struct CompatibilityMatrix : public HalGroup<MatrixHal>, public XmlFileGroup<Mat
     struct {
         Vndk mVndk;
     } device;
+
+    // See buildKernelRequirementTable. If it is not built,
+    // RuntimeInfo::checkCompatibility goes through framework.mKernels instead.
+    DerivedCache<KernelRequirementTable> mKernelRequirements;
 };
 
 } // namespace vintf
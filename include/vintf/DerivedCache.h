@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_DERIVED_CACHE_H
+#define ANDROID_VINTF_DERIVED_CACHE_H
+
+#include <memory>
+
+namespace android {
+namespace vintf {
+
+// Holds immutable data derived from the contents of its owner, such as a lookup table.
+// The data is not carried over when the owner is copied, because the copy may be
+// modified afterwards and the data would go stale. It is carried over when the owner
+// is moved.
+template <typename T>
+class DerivedCache {
+   public:
+    DerivedCache() {}
+    DerivedCache(const DerivedCache&) {}
+    DerivedCache(DerivedCache&&) = default;
+    DerivedCache& operator=(const DerivedCache&) {
+        mData = nullptr;
+        return *this;
+    }
+    DerivedCache& operator=(DerivedCache&&) = default;
+
+    inline const T* get() const { return mData.get(); }
+    inline void set(std::shared_ptr<const T>&& data) { mData = std::move(data); }
+    inline void reset() { mData = nullptr; }
+
+   private:
+    std::shared_ptr<const T> mData;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_DERIVED_CACHE_H
@@ -18,25 +18,54 @@
 #define ANDROID_VINTF_HAL_GROUP_H
 
 #include <map>
+#include <vector>
 
 #include "MapValueIterator.h"
+#include "SortedVectorMultiMap.h"
 
 namespace android {
 namespace vintf {
 
 // A HalGroup is a wrapped multimap from name to Hal.
 // Hal.getName() must return a string indicating the name.
-template <typename Hal>
+// Map is the multimap type that stores the HALs, either std::multimap or
+// SortedVectorMultiMap. With SortedVectorMultiMap, add() invalidates pointers
+// to HALs that are returned by getAnyHal().
+template <typename Hal, typename Map = std::multimap<std::string, Hal>>
 struct HalGroup {
    public:
+    using ConstHalIterable = typename MapIterTypes<Map>::ConstValueIterable;
+
+    HalGroup() = default;
+    HalGroup(const HalGroup&) = default;
+    HalGroup(HalGroup&&) = default;
+    HalGroup& operator=(const HalGroup&) = default;
+    HalGroup& operator=(HalGroup&&) = default;
     virtual ~HalGroup() {}
     // Move all hals from another HalGroup to this.
     bool addAll(HalGroup&& other) {
+        std::vector<Hal> hals;
+        hals.reserve(other.mHals.size());
         for (auto& pair : other.mHals) {
-            if (!add(std::move(pair.second))) {
-                return false;
+            hals.push_back(std::move(pair.second));
+        }
+        return addAll(std::move(hals));
+    }
+
+    // Add hals as if add() were called on each of them in order, but sort them
+    // into mHals once instead of inserting them one by one. If any of them cannot
+    // be added, set *rejected to its index, leave this HalGroup unchanged and
+    // return false.
+    bool addAll(std::vector<Hal>&& hals, size_t* rejected = nullptr) {
+        size_t index = firstRejected(hals);
+        if (index < hals.size()) {
+            if (rejected != nullptr) {
+                *rejected = index;
             }
+            return false;
         }
+        emplaceAll(&mHals, std::move(hals));
+        onHalsChanged();
         return true;
     }
 
@@ -45,24 +74,40 @@ struct HalGroup {
         if (!shouldAdd(hal)) {
             return false;
         }
-        std::string name = hal.getName();
+        typename Map::key_type name = hal.getName();
         mHals.emplace(std::move(name), std::move(hal));  // always succeed
+        onHalsChanged();
         return true;
     }
 
    protected:
     // sorted map from component name to the component.
     // The component name looks like: android.hardware.foo
-    std::multimap<std::string, Hal> mHals;
+    Map mHals;
 
     // override this to filter for add.
     virtual bool shouldAdd(const Hal&) const { return true; }
 
+    // Return the index of the first of hals that add() would reject if it were
+    // called on each of them in order, or hals.size() if none. Override this
+    // together with shouldAdd() if shouldAdd() looks at mHals, so that the HALs
+    // before the rejected one are taken into account.
+    virtual size_t firstRejected(const std::vector<Hal>& hals) const {
+        for (size_t i = 0; i < hals.size(); ++i) {
+            if (!shouldAdd(hals[i])) {
+                return i;
+            }
+        }
+        return hals.size();
+    }
+
+    // Called when mHals is added to or may be modified through a returned pointer.
+    // Override this to drop data derived from mHals.
+    virtual void onHalsChanged() {}
+
     // Return an iterable to all ManifestHal objects. Call it as follows:
     // for (const auto& e : vm.getHals()) { }
-    ConstMultiMapValueIterable<std::string, Hal> getHals() const {
-        return ConstMultiMapValueIterable<std::string, Hal>(mHals);
-    }
+    ConstHalIterable getHals() const { return ConstHalIterable(mHals); }
 
     // Get any HAL component based on the component name. Return any one
     // if multiple. Return nullptr if the component does not exist. This is only
@@ -70,12 +115,31 @@ struct HalGroup {
     // The component name looks like:
     // android.hardware.foo
     Hal* getAnyHal(const std::string& name) {
+        onHalsChanged();
         auto it = mHals.find(name);
         if (it == mHals.end()) {
             return nullptr;
         }
         return &(it->second);
     }
+
+   private:
+    template <typename K>
+    static void emplaceAll(std::multimap<K, Hal>* map, std::vector<Hal>&& hals) {
+        for (auto&& hal : hals) {
+            K name = hal.getName();
+            map->emplace(std::move(name), std::move(hal));
+        }
+    }
+    template <typename K>
+    static void emplaceAll(SortedVectorMultiMap<K, Hal>* map, std::vector<Hal>&& hals) {
+        map->reserve(map->size() + hals.size());
+        for (auto&& hal : hals) {
+            K name = hal.getName();
+            map->append(std::move(name), std::move(hal));
+        }
+        map->sort();
+    }
 };
 
 }  // namespace vintf
@@ -20,13 +20,16 @@
 #include <set>
 #include <string>
 
+#include "Arena.h"
+#include "InternedString.h"
+
 namespace android {
 namespace vintf {
 
 // manifest.hal.interface element / compatibility-matrix.hal.interface element
 struct HalInterface {
-    std::string name;
-    std::set<std::string> instances;
+    InternedString name;
+    ArenaSet<InternedString, std::less<>> instances;
 };
 
 bool operator==(const HalInterface&, const HalInterface&);
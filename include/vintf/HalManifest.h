@@ -23,6 +23,7 @@
 #include <utils/Errors.h>
 #include <vector>
 
+#include "DerivedCache.h"
 #include "HalGroup.h"
 #include "ManifestHal.h"
 #include "MapValueIterator.h"
@@ -37,9 +38,14 @@ namespace vintf {
 struct MatrixHal;
 struct CompatibilityMatrix;
 
+namespace details {
+struct TransportTable;
+}  // namespace details
+
 // A HalManifest is reported by the hardware and query-able from
 // framework code. This is the API for the framework.
-struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestXmlFile> {
+struct HalManifest : public HalGroup<ManifestHal, SortedVectorMultiMap<InternedString, ManifestHal>>,
+                     public XmlFileGroup<ManifestXmlFile> {
    public:
     // manifest.version
     constexpr static Version kVersion{1, 0};
@@ -130,10 +136,13 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
    protected:
     // Check before add()
     bool shouldAdd(const ManifestHal& toAdd) const override;
+    size_t firstRejected(const std::vector<ManifestHal>& hals) const override;
     bool shouldAddXmlFile(const ManifestXmlFile& toAdd) const override;
+    void onHalsChanged() override;
 
    private:
     friend struct HalManifestConverter;
+    friend struct BinaryCodec;
     friend class VintfObject;
     friend class AssembleVintf;
     friend struct LibVintfTest;
@@ -142,10 +151,17 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
 
     // Return an iterable to all ManifestHal objects. Call it as follows:
     // for (const ManifestHal &e : vm.getHals()) { }
-    ConstMultiMapValueIterable<std::string, ManifestHal> getHals() const;
+    ConstHalIterable getHals() const;
 
     status_t fetchAllInformation(const std::string &path);
 
+    // Build mTransportTable from the HALs so that getTransport is a single hash lookup.
+    // The manifest must not be modified afterwards.
+    void buildTransportTable();
+
+    // Return the major versions of the HALs with this name.
+    std::set<size_t> getMajorVersions(const std::string& name) const;
+
     // Check if all instances in matrixHal is supported in this manifest.
     bool isCompatible(const MatrixHal& matrixHal) const;
 
@@ -163,6 +179,10 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
     struct {
         std::vector<Vndk> mVndks;
     } framework;
+
+    // Lookup table for getTransport; see buildTransportTable. If it is not built,
+    // getTransport searches mHals instead.
+    DerivedCache<details::TransportTable> mTransportTable;
 };
 
 
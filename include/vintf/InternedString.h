@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_INTERNED_STRING_H
+#define ANDROID_VINTF_INTERNED_STRING_H
+
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace android {
+namespace vintf {
+
+// An immutable string that is stored once in a process-wide pool. Copies are a
+// pointer and a reference count, and two InternedStrings are equal iff they point
+// to the same string. Ordering is the same as std::string, so containers keyed by
+// InternedString iterate in the same order as before.
+// A string is removed from the pool when its last InternedString is destroyed, so
+// interning names from untrusted package XMLs does not grow the pool for good.
+class InternedString {
+   public:
+    inline InternedString() : mEntry(nullptr) {}
+    InternedString(const std::string& s);
+    InternedString(const char* s);
+    inline InternedString(const InternedString& other) : mEntry(other.mEntry) {
+        if (mEntry != nullptr) {
+            mEntry->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    inline InternedString(InternedString&& other) : mEntry(other.mEntry) {
+        other.mEntry = nullptr;
+    }
+    inline InternedString& operator=(InternedString other) {
+        std::swap(mEntry, other.mEntry);
+        return *this;
+    }
+    inline ~InternedString() {
+        if (mEntry != nullptr) {
+            release(mEntry);
+        }
+    }
+
+    inline const std::string& str() const {
+        return mEntry != nullptr ? *mEntry->string : emptyString();
+    }
+    inline operator const std::string&() const { return str(); }
+    inline const char* c_str() const { return str().c_str(); }
+    inline size_t size() const { return str().size(); }
+    inline bool empty() const { return mEntry == nullptr; }
+
+    inline bool operator==(const InternedString& other) const { return mEntry == other.mEntry; }
+    inline bool operator!=(const InternedString& other) const { return mEntry != other.mEntry; }
+    inline bool operator<(const InternedString& other) const {
+        return mEntry != other.mEntry && str() < other.str();
+    }
+
+    // Number of distinct strings in the pool.
+    static size_t poolSize();
+
+   private:
+    friend struct std::hash<InternedString>;
+
+    // A string in the pool. The empty string is not in the pool; it is nullptr.
+    struct Entry {
+        const std::string* string;
+        std::atomic<size_t> refs;
+        size_t shard;
+    };
+
+    struct Pool;
+
+    static Pool& pool();
+    static const std::string& emptyString();
+    static Entry* intern(const std::string& s);
+    static void release(Entry* entry);
+
+    Entry* mEntry;
+};
+
+// Comparisons with plain strings do not add them to the pool.
+inline bool operator==(const InternedString& a, const std::string& b) { return a.str() == b; }
+inline bool operator==(const std::string& a, const InternedString& b) { return a == b.str(); }
+inline bool operator==(const InternedString& a, const char* b) { return a.str() == b; }
+inline bool operator==(const char* a, const InternedString& b) { return a == b.str(); }
+inline bool operator!=(const InternedString& a, const std::string& b) { return a.str() != b; }
+inline bool operator!=(const std::string& a, const InternedString& b) { return a != b.str(); }
+inline bool operator!=(const InternedString& a, const char* b) { return a.str() != b; }
+inline bool operator!=(const char* a, const InternedString& b) { return a != b.str(); }
+inline bool operator<(const InternedString& a, const std::string& b) { return a.str() < b; }
+inline bool operator<(const std::string& a, const InternedString& b) { return a < b.str(); }
+
+inline std::string operator+(const InternedString& a, const std::string& b) { return a.str() + b; }
+inline std::string operator+(const std::string& a, const InternedString& b) { return a + b.str(); }
+inline std::string operator+(const InternedString& a, const char* b) { return a.str() + b; }
+inline std::string operator+(const char* a, const InternedString& b) { return a + b.str(); }
+
+inline std::ostream& operator<<(std::ostream& os, const InternedString& s) { return os << s.str(); }
+
+}  // namespace vintf
+}  // namespace android
+
+namespace std {
+template <>
+struct hash<::android::vintf::InternedString> {
+    size_t operator()(const ::android::vintf::InternedString& s) const {
+        return hash<const void*>()(s.mEntry);
+    }
+};
+}  // namespace std
+
+#endif  // ANDROID_VINTF_INTERNED_STRING_H
@@ -17,10 +17,12 @@
 #ifndef ANDROID_VINTF_KERNEL_CONFIG_PARSER_H_
 #define ANDROID_VINTF_KERNEL_CONFIG_PARSER_H_
 
+#include <functional>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <utils/Errors.h>
 
@@ -31,17 +33,34 @@ class KernelConfigParser {
    public:
     KernelConfigParser(bool processComments = false, bool relaxedFormat = false);
 
+    // Size of the pieces that processFile() reads and decompresses at a time.
+    static constexpr size_t kDefaultChunkSize = 16 * 1024;
+
     status_t process(const char* buf, size_t len);
     status_t finish();
+
+    // Process the whole file at path or fd, like /proc/config.gz, and then finish().
+    // The file is decompressed if it is gzip-compressed. Decompressed data is parsed
+    // in place, chunkSize bytes at a time. Returns an error if the file cannot be
+    // read or decompressed; like process(), lines that cannot be parsed are skipped
+    // and described in error().
+    status_t processFile(const std::string& path, size_t chunkSize = kDefaultChunkSize);
+    status_t processFile(int fd, size_t chunkSize = kDefaultChunkSize);
     std::stringbuf* error() const;
     std::map<std::string, std::string>& configs();
     const std::map<std::string, std::string>& configs() const;
 
    private:
-    status_t processRemaining();
+    status_t processLine(const char* begin, const char* end);
+    // read(&data) returns the size of the next piece of the file, 0 at the end of
+    // the file, or -errno.
+    status_t processStream(const std::function<ssize_t(const char**)>& read, size_t chunkSize);
     std::map<std::string, std::string> mConfigs;
     std::stringstream mError;
     std::string mRemaining;
+    // Reused by processFile() calls on the same parser.
+    std::vector<char> mInputBuffer;
+    std::vector<char> mOutputBuffer;
     bool mProcessComments;
     bool mRelaxedFormat;
 };
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_KERNEL_CONFIG_TABLE_H
+#define ANDROID_VINTF_KERNEL_CONFIG_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "KernelConfigTypedValue.h"
+
+namespace android {
+namespace vintf {
+
+// An immutable table of kernel configs (CONFIG_xxx to the value after the = sign).
+// All keys and values are stored in a single buffer, and equal values are stored
+// once and parsed once. Entries are sorted by key and are looked up with a binary
+// search.
+//
+// For source compatibility, it can be used like a const
+// std::map<std::string, std::string>, except that at() returns a copy and that
+// iterators are input iterators: each dereference materializes a new std::pair.
+// Use lookup() to avoid that.
+class KernelConfigTable {
+   public:
+    using key_type = std::string;
+    using mapped_type = std::string;
+    using value_type = std::pair<std::string, std::string>;
+    using size_type = size_t;
+
+    class const_iterator {
+       public:
+        // Not a forward iterator, because *it is not a reference to a stored entry.
+        using iterator_category = std::input_iterator_tag;
+        using value_type = KernelConfigTable::value_type;
+        using difference_type = ptrdiff_t;
+        using reference = value_type;
+        struct pointer {
+            value_type entry;
+            inline const value_type* operator->() const { return &entry; }
+        };
+
+        const_iterator() {}
+        inline value_type operator*() const { return mTable->entryAt(mIndex); }
+        inline pointer operator->() const { return pointer{**this}; }
+        inline const_iterator& operator++() {
+            ++mIndex;
+            return *this;
+        }
+        inline const_iterator operator++(int) {
+            const_iterator old = *this;
+            ++mIndex;
+            return old;
+        }
+        inline bool operator==(const const_iterator& other) const {
+            return mIndex == other.mIndex;
+        }
+        inline bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+       private:
+        friend class KernelConfigTable;
+        const_iterator(const KernelConfigTable* table, size_t index)
+            : mTable(table), mIndex(index) {}
+        const KernelConfigTable* mTable = nullptr;
+        size_t mIndex = 0;
+    };
+    using iterator = const_iterator;
+
+    KernelConfigTable() {}
+    KernelConfigTable(const std::map<std::string, std::string>& configs);
+    // If a key is duplicated, the first value is kept, like std::map.
+    KernelConfigTable(std::initializer_list<value_type> configs);
+
+    inline size_t size() const { return mEntries.size(); }
+    inline bool empty() const { return mEntries.empty(); }
+    inline const_iterator begin() const { return const_iterator(this, 0); }
+    inline const_iterator end() const { return const_iterator(this, size()); }
+    const_iterator find(const std::string& key) const;
+    inline size_t count(const std::string& key) const { return find(key) == end() ? 0 : 1; }
+    // Abort if key does not exist.
+    std::string at(const std::string& key) const;
+
+    // Look up key without allocating or parsing. On success, value->string
+    // points into the table and stays valid as long as the table.
+    bool lookup(const char* key, size_t keyLength, ParsedKernelConfigValue* value) const;
+
+    bool operator==(const KernelConfigTable& other) const;
+    inline bool operator!=(const KernelConfigTable& other) const { return !(*this == other); }
+
+   private:
+    struct Entry {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t valueIndex;  // into mValues
+    };
+    struct Value {
+        uint32_t offset;
+        // string is always null; lookup() fills it in, so the table can be copied.
+        ParsedKernelConfigValue parsed;
+    };
+
+    // configs must be sorted by key, without duplicated keys.
+    template <typename Iterator>
+    void build(Iterator begin, Iterator end);
+    size_t lowerBound(const char* key, size_t keyLength) const;
+    bool keyEquals(const Entry& entry, const char* key, size_t keyLength) const;
+    value_type entryAt(size_t index) const;
+    std::string valueAt(const Entry& entry) const;
+
+    std::string mStrings;
+    std::vector<Entry> mEntries;
+    std::vector<Value> mValues;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_KERNEL_CONFIG_TABLE_H
@@ -28,6 +28,26 @@ namespace vintf {
 using KernelConfigIntValue = int64_t;
 using KernelConfigRangeValue = std::pair<uint64_t, uint64_t>;
 
+// A kernel config value in /proc/config.gz, such as "y", "0x10", "1-3" or "\"str\"",
+// together with the types that it parses as. It is parsed once when the configs are
+// fetched, so matching it against many KernelConfigTypedValue's does not parse it again.
+struct ParsedKernelConfigValue {
+    ParsedKernelConfigValue() {}
+    // Parse s as every type. string is left empty.
+    explicit ParsedKernelConfigValue(const std::string &s);
+
+    // The value as it appears in /proc/config.gz. Not owned.
+    const char *string = nullptr;
+    size_t length = 0;
+
+    bool isTristate = false;
+    bool isInteger = false;
+    bool isRange = false;
+    Tristate tristateValue = Tristate::NO;
+    KernelConfigIntValue integerValue = 0;
+    KernelConfigRangeValue rangeValue;
+};
+
 // compatibility-matrix.kernel.config.value item.
 struct KernelConfigTypedValue {
 
@@ -44,9 +64,12 @@ struct KernelConfigTypedValue {
     bool operator==(const KernelConfigTypedValue &other) const;
 
     bool matchValue(const std::string &) const;
+    // Same as above, but does not parse or allocate.
+    bool matchValue(const ParsedKernelConfigValue &) const;
 
 private:
     friend struct KernelConfigTypedValueConverter;
+    friend struct BinaryCodec;
     friend std::ostream &operator<<(std::ostream &os, const KernelConfigTypedValue &kctv);
     friend bool parseKernelConfigValue(const std::string &s, KernelConfigTypedValue *kctv);
     friend bool parseKernelConfigTypedValue(const std::string& s, KernelConfigTypedValue* kctv);
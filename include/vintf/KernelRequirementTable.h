@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_KERNEL_REQUIREMENT_TABLE_H
+#define ANDROID_VINTF_KERNEL_REQUIREMENT_TABLE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "KernelConfigTypedValue.h"
+#include "MatrixKernel.h"
+#include "Version.h"
+
+namespace android {
+namespace vintf {
+
+struct RuntimeInfo;
+
+// The <kernel> fragments of a framework compatibility matrix, compiled for
+// RuntimeInfo::checkCompatibility. Each distinct config key is stored once as a
+// slot, and each distinct (key, value) requirement is stored once; fragments
+// refer to requirements by index. Matching a RuntimeInfo looks up each slot and
+// evaluates each requirement at most once, however many fragments repeat it.
+class KernelRequirementTable {
+   public:
+    static std::shared_ptr<const KernelRequirementTable> build(
+        const std::vector<MatrixKernel>& kernels);
+
+    // Same result and error as matching runtimeInfo against the fragments one by
+    // one; see RuntimeInfo::matchKernels.
+    bool match(const RuntimeInfo& runtimeInfo, std::string* error) const;
+
+   private:
+    struct Requirement {
+        uint32_t slot;
+        KernelConfigTypedValue value;
+    };
+    struct Fragment {
+        KernelVersion minLts;
+        // Ranges in mRequirementIndices: conditions are [conditionsBegin, configsBegin)
+        // and configs are [configsBegin, configsEnd).
+        uint32_t conditionsBegin;
+        uint32_t configsBegin;
+        uint32_t configsEnd;
+    };
+    class Matcher;
+
+    std::vector<std::string> mKeys;  // by slot
+    std::vector<Requirement> mRequirements;
+    std::vector<uint32_t> mRequirementIndices;
+    std::vector<Fragment> mFragments;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_KERNEL_REQUIREMENT_TABLE_H
@@ -22,8 +22,10 @@
 #include <vector>
 #include <map>
 
+#include "Arena.h"
 #include "HalFormat.h"
 #include "HalInterface.h"
+#include "InternedString.h"
 #include "TransportArch.h"
 #include "Version.h"
 
@@ -36,10 +38,10 @@ struct ManifestHal {
     bool operator==(const ManifestHal &other) const;
 
     HalFormat format = HalFormat::HIDL;
-    std::string name;
+    InternedString name;
     std::vector<Version> versions;
     TransportArch transportArch;
-    std::map<std::string, HalInterface> interfaces;
+    ArenaMap<InternedString, HalInterface, std::less<>> interfaces;
 
     inline bool hasVersion(Version v) const {
         return std::find(versions.begin(), versions.end(), v) != versions.end();
@@ -48,7 +50,7 @@ struct ManifestHal {
         return transportArch.transport;
     }
 
-    inline const std::string& getName() const { return name; }
+    inline const InternedString& getName() const { return name; }
 
    private:
     friend struct LibVintfTest;
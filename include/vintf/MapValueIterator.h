@@ -102,13 +102,16 @@ struct MapIterTypes {
     using ConstValueIterable = IterableImpl<true>;
 };
 
-template<typename K, typename V>
-using ConstMapValueIterable = typename MapIterTypes<std::map<K, V>>::ConstValueIterable;
+template<typename K, typename V, typename Compare = std::less<K>,
+         typename Allocator = std::allocator<std::pair<const K, V>>>
+using ConstMapValueIterable =
+    typename MapIterTypes<std::map<K, V, Compare, Allocator>>::ConstValueIterable;
 template<typename K, typename V>
 using ConstMultiMapValueIterable = typename MapIterTypes<std::multimap<K, V>>::ConstValueIterable;
 
-template<typename K, typename V>
-ConstMapValueIterable<K, V> iterateValues(const std::map<K, V> &map) {
+template<typename K, typename V, typename Compare, typename Allocator>
+ConstMapValueIterable<K, V, Compare, Allocator> iterateValues(
+        const std::map<K, V, Compare, Allocator> &map) {
     return map;
 }
 template<typename K, typename V>
@@ -21,8 +21,10 @@
 #include <string>
 #include <vector>
 
+#include "Arena.h"
 #include "HalFormat.h"
 #include "HalInterface.h"
+#include "InternedString.h"
 #include "VersionRange.h"
 
 namespace android {
@@ -34,12 +36,12 @@ struct MatrixHal {
     bool operator==(const MatrixHal &other) const;
 
     HalFormat format = HalFormat::HIDL;
-    std::string name;
+    InternedString name;
     std::vector<VersionRange> versionRanges;
     bool optional = false;
-    std::map<std::string, HalInterface> interfaces;
+    ArenaMap<InternedString, HalInterface, std::less<>> interfaces;
 
-    inline const std::string& getName() const { return name; }
+    inline const InternedString& getName() const { return name; }
 };
 
 } // namespace vintf
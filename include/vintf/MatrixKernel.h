@@ -58,6 +58,7 @@ struct MatrixKernel {
    private:
     friend struct MatrixKernelConverter;
     friend struct MatrixKernelConditionsConverter;
+    friend struct BinaryCodec;
     friend class AssembleVintf;
 
     KernelVersion mMinLts;
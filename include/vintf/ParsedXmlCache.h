@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_PARSED_XML_CACHE_H_
+#define ANDROID_VINTF_PARSED_XML_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace android {
+namespace vintf {
+
+struct CompatibilityMatrix;
+struct HalManifest;
+
+/*
+ * Manifests and compatibility matrices parsed from package XMLs, so that checking
+ * the same XML again does not parse it again. Entries are keyed by a hash of the
+ * XML and are evicted in least-recently-used order when there are more than
+ * capacity() of them. The XML is kept with each entry and compared on a hit, so
+ * a hash collision is only a miss.
+ * Cached objects are immutable and shared by all callers.
+ * All operations are thread-safe.
+ */
+class ParsedXmlCache {
+   public:
+    static constexpr size_t kDefaultCapacity = 16;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    explicit ParsedXmlCache(size_t capacity = kDefaultCapacity);
+
+    // Parse xml as a manifest or as a matrix, depending on its root element, or
+    // return the objects parsed from the same XML before. On success, exactly one
+    // of *manifest and *matrix is set. Failures are not cached.
+    bool parse(const std::string& xml, std::shared_ptr<const HalManifest>* manifest,
+               std::shared_ptr<const CompatibilityMatrix>* matrix);
+
+    // Evicts entries if there are more than capacity. 0 disables caching.
+    void setCapacity(size_t capacity);
+    size_t capacity() const;
+    Stats stats() const;
+    // Remove all entries and reset the counters.
+    void clear();
+
+   private:
+    struct Entry {
+        size_t hash;
+        std::string xml;
+        std::shared_ptr<const HalManifest> manifest;
+        std::shared_ptr<const CompatibilityMatrix> matrix;
+    };
+    using Entries = std::list<Entry>;
+
+    // Requires mMutex.
+    void evict(size_t capacity);
+
+    mutable std::mutex mMutex;
+    size_t mCapacity;
+    // Most recently used first.
+    Entries mEntries;
+    std::unordered_map<size_t, Entries::iterator> mIndex;
+    Stats mStats;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_PARSED_XML_CACHE_H_
@@ -26,6 +26,7 @@
 #include <utils/Errors.h>
 
 #include "DisabledChecks.h"
+#include "KernelConfigTable.h"
 #include "MatrixKernel.h"
 #include "Version.h"
 
@@ -33,12 +34,34 @@ namespace android {
 namespace vintf {
 
 struct CompatibilityMatrix;
+class KernelRequirementTable;
 
 // Runtime Info sent to OTA server
 struct RuntimeInfo {
 
     RuntimeInfo() {}
 
+    // Parts of the runtime info that are fetched separately.
+    using FetchFlags = uint32_t;
+    enum FetchFlag : FetchFlags {
+        // uname: osName(), nodeName(), osRelease(), osVersion(), hardwareId(), kernelVersion()
+        CPU_VERSION = 1 << 0,
+        // /proc/config.gz: kernelConfigs()
+        CONFIG_GZ = 1 << 1,
+        // /proc/cpuinfo: cpuInfo()
+        CPU_INFO = 1 << 2,
+        // kernelSepolicyVersion()
+        POLICYVERS = 1 << 3,
+        // bootVbmetaAvbVersion(), bootAvbVersion()
+        AVB = 1 << 4,
+
+        NONE = 0,
+        ALL = (1 << 5) - 1,
+    };
+
+    // The parts that have been fetched. The others have default values.
+    FetchFlags fetchedFlags() const;
+
     // /proc/version
     // utsname.sysname
     const std::string &osName() const;
@@ -53,7 +76,7 @@ struct RuntimeInfo {
     // extract from utsname.release
     const KernelVersion &kernelVersion() const;
 
-    const std::map<std::string, std::string> &kernelConfigs() const;
+    const KernelConfigTable &kernelConfigs() const;
 
     const Version &bootVbmetaAvbVersion() const;
     const Version &bootAvbVersion() const;
@@ -76,11 +99,16 @@ struct RuntimeInfo {
 
    private:
     friend struct RuntimeInfoFetcher;
+    friend class KernelRequirementTable;
     friend class VintfObject;
     friend struct LibVintfTest;
+    friend struct LibVintfBenchmark;
     friend std::string dump(const RuntimeInfo &ki);
 
-    status_t fetchAllInformation();
+    // Fetch the parts in flags and add them to mFetchedFlags. If parallel, the
+    // slow sources (/proc/config.gz and /proc/cpuinfo) are read on their own
+    // threads while the others are read on this thread.
+    status_t fetchAllInformation(FetchFlags flags = ALL, bool parallel = false);
 
     // mKernelVersion = x'.y'.z', minLts = x.y.z,
     // match if x == x' , y == y' , and z <= z'.
@@ -88,10 +116,13 @@ struct RuntimeInfo {
     // return true if all kernel configs in matrixConfigs matches.
     bool matchKernelConfigs(const std::vector<KernelConfig>& matrixConfigs,
                             std::string* error = nullptr) const;
+    // return true if the kernel version matches a fragment in kernels, and the
+    // configs of all fragments with matching version and conditions match.
+    bool matchKernels(const std::vector<MatrixKernel>& kernels, std::string* error) const;
 
     // /proc/config.gz
     // Key: CONFIG_xxx; Value: the value after = sign.
-    std::map<std::string, std::string> mKernelConfigs;
+    KernelConfigTable mKernelConfigs;
     std::string mOsName;
     std::string mNodeName;
     std::string mOsRelease;
@@ -105,6 +136,8 @@ struct RuntimeInfo {
     Version mBootAvbVersion;
 
     size_t mKernelSepolicyVersion = 0u;
+
+    FetchFlags mFetchedFlags = NONE;
 };
 
 } // namespace vintf
@@ -45,6 +45,7 @@ struct Sepolicy {
     }
 private:
     friend struct SepolicyConverter;
+    friend struct BinaryCodec;
     KernelSepolicyVersion mKernelSepolicyVersion;
     std::vector<VersionRange> mSepolicyVersionRanges;
 };
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_SORTED_VECTOR_MULTI_MAP_H
+#define ANDROID_VINTF_SORTED_VECTOR_MULTI_MAP_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "MapValueIterator.h"
+
+namespace android {
+namespace vintf {
+
+// A multimap that stores its pairs in one vector sorted by key. It implements the
+// part of the std::multimap interface that HalGroup uses, with the same order:
+// equal keys are kept in insertion order. Lookups accept any type that compares
+// with K, so that looking up a std::string does not construct a K.
+// Lookup and iteration go over contiguous memory, but emplace is linear and
+// invalidates all iterators and pointers to elements. To insert many pairs, call
+// append() for each of them and then sort() once.
+template <typename K, typename V>
+class SortedVectorMultiMap {
+   public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    iterator begin() { return mPairs.begin(); }
+    iterator end() { return mPairs.end(); }
+    const_iterator begin() const { return mPairs.begin(); }
+    const_iterator end() const { return mPairs.end(); }
+    size_t size() const { return mPairs.size(); }
+    bool empty() const { return mPairs.empty(); }
+    void clear() { mPairs.clear(); }
+    void reserve(size_t n) { mPairs.reserve(n); }
+
+    iterator emplace(K&& key, V&& value) {
+        iterator it = upperBound(mPairs.begin(), mPairs.end(), key);
+        return mPairs.emplace(it, std::move(key), std::move(value));
+    }
+
+    // Add a pair to the end without keeping the order. sort() must be called
+    // before any lookup.
+    void append(K&& key, V&& value) { mPairs.emplace_back(std::move(key), std::move(value)); }
+
+    // Restore the order after append(). Pairs with equal keys stay in the order
+    // they were added, as if each of them was inserted with emplace().
+    void sort() {
+        std::stable_sort(mPairs.begin(), mPairs.end(),
+                         [](const value_type& a, const value_type& b) { return a.first < b.first; });
+    }
+
+    template <typename Key>
+    iterator find(const Key& key) {
+        iterator it = lowerBound(mPairs.begin(), mPairs.end(), key);
+        return it != mPairs.end() && it->first == key ? it : mPairs.end();
+    }
+    template <typename Key>
+    const_iterator find(const Key& key) const {
+        const_iterator it = lowerBound(mPairs.begin(), mPairs.end(), key);
+        return it != mPairs.end() && it->first == key ? it : mPairs.end();
+    }
+
+    template <typename Key>
+    std::pair<iterator, iterator> equal_range(const Key& key) {
+        iterator first = lowerBound(mPairs.begin(), mPairs.end(), key);
+        return {first, upperBound(first, mPairs.end(), key)};
+    }
+    template <typename Key>
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+        const_iterator first = lowerBound(mPairs.begin(), mPairs.end(), key);
+        return {first, upperBound(first, mPairs.end(), key)};
+    }
+
+    bool operator==(const SortedVectorMultiMap& other) const { return mPairs == other.mPairs; }
+    bool operator!=(const SortedVectorMultiMap& other) const { return !(*this == other); }
+
+   private:
+    template <typename Iter, typename Key>
+    static Iter lowerBound(Iter first, Iter last, const Key& key) {
+        return std::lower_bound(first, last, key,
+                                [](const value_type& pair, const Key& k) { return pair.first < k; });
+    }
+    template <typename Iter, typename Key>
+    static Iter upperBound(Iter first, Iter last, const Key& key) {
+        return std::upper_bound(first, last, key,
+                                [](const Key& k, const value_type& pair) { return k < pair.first; });
+    }
+
+    std::vector<value_type> mPairs;
+};
+
+template <typename K, typename V>
+using ConstSortedVectorMultiMapValueIterable =
+    typename MapIterTypes<SortedVectorMultiMap<K, V>>::ConstValueIterable;
+
+template <typename K, typename V>
+ConstSortedVectorMultiMapValueIterable<K, V> iterateValues(const SortedVectorMultiMap<K, V>& map) {
+    return map;
+}
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_SORTED_VECTOR_MULTI_MAP_H
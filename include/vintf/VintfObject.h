@@ -17,13 +17,85 @@
 #ifndef ANDROID_VINTF_VINTF_OBJECT_H_
 #define ANDROID_VINTF_VINTF_OBJECT_H_
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "CompatibilityMatrix.h"
 #include "DisabledChecks.h"
 #include "HalManifest.h"
+#include "ParsedXmlCache.h"
 #include "RuntimeInfo.h"
 
 namespace android {
 namespace vintf {
+
+namespace details {
+class PartitionMounter;
+
+// The checks that CheckCompatibility runs between the parts after an update.
+enum class UpdateCheck {
+    DEVICE_MANIFEST,     // device manifest vs. framework matrix
+    FRAMEWORK_MANIFEST,  // framework manifest vs. device matrix
+    RUNTIME_INFO,        // runtime info vs. framework matrix
+};
+
+// Remembers the results of the checks that CheckCompatibility runs.
+class CheckResultCache {
+   public:
+    virtual ~CheckResultCache() {}
+    // Return the result of check between first and second. If it is not known, call
+    // run(error) to compute it. On failure, *error is set to the reason.
+    virtual bool check(UpdateCheck check, const std::shared_ptr<const void>& first,
+                       const std::shared_ptr<const void>& second, DisabledChecks disabledChecks,
+                       std::string* error, const std::function<bool(std::string*)>& run) = 0;
+};
+
+int32_t checkCompatibility(const std::vector<std::string>& xmls, bool mount,
+                           const PartitionMounter& partitionMounter, std::string* error,
+                           DisabledChecks disabledChecks, CheckResultCache* cache);
+}  // namespace details
+
+/*
+ * The device-side manifests, matrices and runtime info, read once so that many
+ * packages can be checked against the same state. A missing part is nullptr.
+ */
+struct DeviceSnapshot {
+    std::shared_ptr<const HalManifest> deviceManifest;
+    std::shared_ptr<const HalManifest> frameworkManifest;
+    std::shared_ptr<const CompatibilityMatrix> deviceMatrix;
+    std::shared_ptr<const CompatibilityMatrix> frameworkMatrix;
+    std::shared_ptr<const RuntimeInfo> runtimeInfo;
+};
+
+/*
+ * An immutable, versioned snapshot of the device, published by
+ * VintfObject::GetVintfSnapshot. All parts were read by the same refresh, so readers
+ * never see a mix of objects from before and after a change on the device. Holding
+ * the shared_ptr pins the snapshot while newer ones are published.
+ */
+class VintfSnapshot {
+   public:
+    // Increases each time a snapshot with different parts is published.
+    uint64_t version() const { return mVersion; }
+    const DeviceSnapshot& device() const { return mDevice; }
+
+   private:
+    friend class VintfObject;
+    VintfSnapshot(uint64_t version, DeviceSnapshot device)
+        : mVersion(version), mDevice(std::move(device)) {}
+
+    const uint64_t mVersion;
+    const DeviceSnapshot mDevice;
+};
+
+// Result of checking one package. See VintfObject::CheckCompatibility.
+struct CompatibilityResult {
+    int32_t status;
+    std::string error;
+};
+
 /*
  * The top level class for libvintf.
  * An overall diagram of the public API:
@@ -44,9 +116,12 @@ namespace vintf {
  * file won't be touched again.
  * If any error, nullptr is returned, and Get will try to parse the HAL manifest
  * again when it is called again.
- * All these operations are thread-safe.
+ * All these operations are thread-safe. Once an object is cached, reading it does not
+ * take any lock.
  * If skipCache, always skip the cache in memory and read the files / get runtime information
- * again from the device.
+ * again from the device. Pointers returned earlier stay valid: an object that has been
+ * returned as a raw pointer is retired instead of freed when it is superseded. Use the
+ * GetShared* variants to let superseded objects be freed once the caller releases them.
  */
 class VintfObject {
 public:
@@ -79,6 +154,27 @@ public:
      */
     static const RuntimeInfo *GetRuntimeInfo(bool skipCache = false);
 
+    /*
+     * Same as above, except that only the parts in flags are guaranteed to be fetched.
+     * If the cached object lacks some of them, a copy with the missing parts fetched
+     * replaces it, so parts that are never requested (e.g. /proc/config.gz) are never read.
+     */
+    static const RuntimeInfo *GetRuntimeInfo(bool skipCache, RuntimeInfo::FetchFlags flags);
+
+    /*
+     * Same as the getters above, except that the object is freed once it has been
+     * superseded and the last caller has released it.
+     */
+    static std::shared_ptr<const HalManifest> GetSharedDeviceHalManifest(bool skipCache = false);
+    static std::shared_ptr<const HalManifest> GetSharedFrameworkHalManifest(
+        bool skipCache = false);
+    static std::shared_ptr<const CompatibilityMatrix> GetSharedDeviceCompatibilityMatrix(
+        bool skipCache = false);
+    static std::shared_ptr<const CompatibilityMatrix> GetSharedFrameworkCompatibilityMatrix(
+        bool skipCache = false);
+    static std::shared_ptr<const RuntimeInfo> GetSharedRuntimeInfo(
+        bool skipCache = false, RuntimeInfo::FetchFlags flags = RuntimeInfo::ALL);
+
     /**
      * Check compatibility, given a set of manifests / matrices in packageInfo.
      * They will be checked against the manifests / matrices on the device.
@@ -88,6 +184,9 @@ public:
      * @param error error message
      * @param disabledChecks flags to disable certain checks. See DisabledChecks.
      *
+     * Manifests and matrices on the device are only read again if they have changed
+     * (by inode, size and modification time) since they were last read.
+     *
      * @return = 0 if success (compatible)
      *         > 0 if incompatible
      *         < 0 if any error (mount partition fails, illformed XML, etc.)
@@ -95,6 +194,54 @@ public:
     static int32_t CheckCompatibility(const std::vector<std::string>& packageInfo,
                                       std::string* error = nullptr,
                                       DisabledChecks disabledChecks = ENABLE_ALL_CHECKS);
+
+    /*
+     * Get the manifests, matrices and runtime info of the device for CheckCompatibility
+     * below. Cached files are only reused if they have not changed on the device.
+     */
+    static DeviceSnapshot GetDeviceSnapshot();
+
+    /*
+     * Return the published snapshot of the device. If refresh or if none is published
+     * yet, the five parts are read concurrently, files only if they have changed, and
+     * a new snapshot is published if any part differs from the current one.
+     */
+    static std::shared_ptr<const VintfSnapshot> GetVintfSnapshot(bool refresh = false);
+
+    /**
+     * Check each of packages against device, like CheckCompatibility above. Parts
+     * missing from a package are taken from device instead of being read again.
+     * Packages are checked in parallel on up to numThreads threads; 0 means the number
+     * of cores.
+     *
+     * @return one result per package, in the same order.
+     */
+    static std::vector<CompatibilityResult> CheckCompatibility(
+        const DeviceSnapshot& device, const std::vector<std::vector<std::string>>& packages,
+        DisabledChecks disabledChecks = ENABLE_ALL_CHECKS, size_t numThreads = 0);
+
+    /*
+     * Return the cache of package XMLs parsed by CheckCompatibility. Use it to
+     * change the number of cached XMLs or to read the hit and miss counters.
+     */
+    static ParsedXmlCache& GetParsedXmlCache();
+
+   private:
+    friend int32_t details::checkCompatibility(const std::vector<std::string>& xmls, bool mount,
+                                               const details::PartitionMounter& partitionMounter,
+                                               std::string* error,
+                                               DisabledChecks disabledChecks,
+                                               details::CheckResultCache* cache);
+
+    // Same as Get*(false), except that the file is read again if it has changed on
+    // the device since it was cached.
+    static std::shared_ptr<const HalManifest> GetDeviceHalManifestIfChanged();
+    static std::shared_ptr<const HalManifest> GetFrameworkHalManifestIfChanged();
+    static std::shared_ptr<const CompatibilityMatrix> GetDeviceCompatibilityMatrixIfChanged();
+    static std::shared_ptr<const CompatibilityMatrix> GetFrameworkCompatibilityMatrixIfChanged();
+
+    // Read all parts of the device state concurrently, files only if they have changed.
+    static DeviceSnapshot LoadDeviceSnapshot(RuntimeInfo::FetchFlags runtimeInfoFlags);
 };
 
 enum : int32_t {
@@ -102,12 +249,14 @@ enum : int32_t {
     INCOMPATIBLE = 1,
 };
 
-// exposed for testing and VintfObjectRecovery.
+// exposed for testing, CompatibilityChecker and VintfObjectRecovery.
+// If cache is set, the results of the checks are looked up in and added to it.
 namespace details {
 class PartitionMounter;
 int32_t checkCompatibility(const std::vector<std::string>& xmls, bool mount,
                            const PartitionMounter& partitionMounter, std::string* error,
-                           DisabledChecks disabledChecks = ENABLE_ALL_CHECKS);
+                           DisabledChecks disabledChecks = ENABLE_ALL_CHECKS,
+                           CheckResultCache* cache = nullptr);
 } // namespace details
 
 } // namespace vintf
@@ -21,6 +21,8 @@
 #include <set>
 #include <string>
 
+#include "Arena.h"
+
 namespace android {
 namespace vintf {
 
@@ -43,17 +45,18 @@ struct VndkVersionRange {
 struct Vndk {
 
     const VndkVersionRange &versionRange() const { return mVersionRange; }
-    const std::set<std::string> &libraries() const { return mLibraries; }
+    const ArenaSet<std::string> &libraries() const { return mLibraries; }
 
 private:
     friend struct VndkConverter;
     friend struct HalManifestConverter;
+    friend struct BinaryCodec;
     friend struct LibVintfTest;
     friend struct HalManifest;
     friend struct CompatibilityMatrix;
     friend bool operator==(const Vndk &, const Vndk &);
     VndkVersionRange mVersionRange;
-    std::set<std::string> mLibraries;
+    ArenaSet<std::string> mLibraries;
 };
 
 inline bool operator==(const VndkVersionRange &lft, const VndkVersionRange &rgt) {
@@ -45,6 +45,7 @@ struct MatrixXmlFile : public XmlFile {
 
    private:
     friend struct MatrixXmlFileConverter;
+    friend struct BinaryCodec;
     friend struct LibVintfTest;
     bool mOptional;
     XmlSchemaFormat mFormat;
@@ -58,6 +59,7 @@ struct ManifestXmlFile : public XmlFile {
 
    private:
     friend struct ManifestXmlFileConverter;
+    friend struct BinaryCodec;
     friend struct LibVintfTest;
     Version mVersion;
 };
@@ -37,6 +37,11 @@ struct XmlFileGroup {
     using const_range = std::pair<typename map::const_iterator, typename map::const_iterator>;
 
    public:
+    XmlFileGroup() = default;
+    XmlFileGroup(const XmlFileGroup&) = default;
+    XmlFileGroup(XmlFileGroup&&) = default;
+    XmlFileGroup& operator=(const XmlFileGroup&) = default;
+    XmlFileGroup& operator=(XmlFileGroup&&) = default;
     virtual ~XmlFileGroup() {}
 
     bool addXmlFile(T&& t) {
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_PARSE_BINARY_H
+#define ANDROID_VINTF_PARSE_BINARY_H
+
+#include <stddef.h>
+
+#include <string>
+
+#include "CompatibilityMatrix.h"
+#include "HalManifest.h"
+
+namespace android {
+namespace vintf {
+
+// A binary image is a compact, versioned encoding of a HalManifest or a
+// CompatibilityMatrix that is decoded without parsing XML. assemble_vintf
+// compiles it from the XML file it writes. The image records the size and hash
+// of that XML file, so an image that no longer matches the XML file is
+// rejected and the XML file is parsed instead. Timestamps are not used, because
+// image builds reset them to a fixed time.
+template <typename Object>
+struct BinaryConverter {
+    BinaryConverter() {}
+    virtual ~BinaryConverter() {}
+    virtual const std::string &lastError() const = 0;
+    // Encode o, which is the result of parsing sourceXml, into an image.
+    virtual std::string serialize(const Object &o, const std::string &sourceXml) const = 0;
+    // Decode the image in [data, data + size). Fail if the image is malformed
+    // or is not compiled from sourceXml.
+    virtual bool deserialize(Object *o, const void *data, size_t size,
+                             const std::string &sourceXml) const = 0;
+};
+
+extern const BinaryConverter<HalManifest> &gHalManifestBinaryConverter;
+
+extern const BinaryConverter<CompatibilityMatrix> &gCompatibilityMatrixBinaryConverter;
+
+// Return the location of the image compiled from the XML file at xmlPath.
+std::string binaryImagePath(const std::string &xmlPath);
+
+} // namespace vintf
+} // namespace android
+
+#endif // ANDROID_VINTF_PARSE_BINARY_H
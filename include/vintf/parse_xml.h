@@ -17,6 +17,9 @@
 #ifndef ANDROID_VINTF_PARSE_XML_H
 #define ANDROID_VINTF_PARSE_XML_H
 
+#include <iosfwd>
+#include <string>
+
 #include "CompatibilityMatrix.h"
 #include "HalManifest.h"
 
@@ -29,6 +32,10 @@ struct XmlConverter {
     virtual ~XmlConverter() {}
     virtual const std::string &lastError() const = 0;
     virtual std::string serialize(const Object &o) const = 0;
+    // Append the XML to out, or write it to out, without building the whole
+    // document in memory first.
+    virtual void serialize(const Object &o, std::string *out) const = 0;
+    virtual void serialize(const Object &o, std::ostream &out) const = 0;
     virtual bool deserialize(Object *o, const std::string &xml) const = 0;
     virtual std::string operator()(const Object &o) const = 0;
     virtual bool operator()(Object *o, const std::string &xml) const = 0;
@@ -38,6 +45,11 @@ extern const XmlConverter<HalManifest> &gHalManifestConverter;
 
 extern const XmlConverter<CompatibilityMatrix> &gCompatibilityMatrixConverter;
 
+// Return the name of the root element of xml, e.g. "manifest", or an empty string if
+// there is none. Only the part up to the root start tag is read, so this does not
+// check that the document is well-formed.
+std::string getRootElementName(const std::string &xml);
+
 } // namespace vintf
 } // namespace android
 
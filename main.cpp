@@ -27,25 +27,25 @@ int main(int, char **) {
 
     const HalManifest *vm = VintfObject::GetDeviceHalManifest();
     if (vm != nullptr)
-        std::cout << gHalManifestConverter(*vm);
+        gHalManifestConverter.serialize(*vm, std::cout);
 
     std::cout << "======== Framework HAL Manifest =========" << std::endl;
 
     const HalManifest *fm = VintfObject::GetFrameworkHalManifest();
     if (fm != nullptr)
-        std::cout << gHalManifestConverter(*fm);
+        gHalManifestConverter.serialize(*fm, std::cout);
 
     std::cout << "======== Device Compatibility Matrix =========" << std::endl;
 
     const CompatibilityMatrix *vcm = VintfObject::GetDeviceCompatibilityMatrix();
     if (vcm != nullptr)
-        std::cout << gCompatibilityMatrixConverter(*vcm);
+        gCompatibilityMatrixConverter.serialize(*vcm, std::cout);
 
     std::cout << "======== Framework Compatibility Matrix =========" << std::endl;
 
     const CompatibilityMatrix *fcm = VintfObject::GetFrameworkCompatibilityMatrix();
     if (fcm != nullptr)
-        std::cout << gCompatibilityMatrixConverter(*fcm);
+        gCompatibilityMatrixConverter.serialize(*fcm, std::cout);
 
     std::cout << "======== Runtime Info =========" << std::endl;
 
@@ -0,0 +1,551 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Convert objects from and to binary images.
+
+#define LOG_TAG "libvintf"
+#include <android-base/logging.h>
+
+#include "parse_binary.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Arena.h"
+#include "utils.h"
+
+namespace android {
+namespace vintf {
+
+// --------------- image layout
+
+// An image is an ImageHeader followed by payloadSize bytes of payload. Integers
+// are stored in host byte order; an image is only read on the device it is built for.
+// In the payload, integers and enums are 32-bit, sizes and versions are 64-bit,
+// and strings and containers are prefixed with their 32-bit element count.
+
+static constexpr char kImageMagic[8] = {'V', 'I', 'N', 'T', 'F', 'B', 'I', 'N'};
+
+// Increase when the encoding of any object changes.
+static constexpr uint32_t kImageFormatVersion = 3;
+
+enum class ImageKind : uint32_t {
+    HAL_MANIFEST = 1,
+    COMPATIBILITY_MATRIX = 2,
+};
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t kind;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+    uint64_t payloadSize;
+};
+
+// 64-bit FNV-1a of the source XML file.
+static uint64_t hashSource(const std::string &source) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+class ImageWriter {
+   public:
+    inline void writeU32(uint32_t v) { append(&v, sizeof(v)); }
+    inline void writeU64(uint64_t v) { append(&v, sizeof(v)); }
+    inline void writeString(const std::string &s) {
+        writeU32(s.size());
+        mBuffer.append(s);
+    }
+    inline const std::string &buffer() const { return mBuffer; }
+
+   private:
+    inline void append(const void *data, size_t size) {
+        mBuffer.append(static_cast<const char *>(data), size);
+    }
+    std::string mBuffer;
+};
+
+// Reads from [begin, end). All reads are bounds-checked.
+class ImageReader {
+   public:
+    ImageReader(const uint8_t *begin, const uint8_t *end) : mPos(begin), mEnd(end) {}
+
+    inline bool readU32(uint32_t *v) { return read(v, sizeof(*v)); }
+    inline bool readU64(uint64_t *v) { return read(v, sizeof(*v)); }
+    inline bool readSize(size_t *v) {
+        uint64_t u;
+        if (!readU64(&u) || u > SIZE_MAX) {
+            return false;
+        }
+        *v = u;
+        return true;
+    }
+    inline bool readString(std::string *s) {
+        uint32_t size;
+        if (!readU32(&size) || size > remaining()) {
+            return false;
+        }
+        s->assign(reinterpret_cast<const char *>(mPos), size);
+        mPos += size;
+        return true;
+    }
+    inline bool readString(InternedString *s) {
+        std::string value;
+        if (!readString(&value)) {
+            return false;
+        }
+        *s = value;
+        return true;
+    }
+    inline bool atEnd() const { return mPos == mEnd; }
+
+   private:
+    inline size_t remaining() const { return mEnd - mPos; }
+    inline bool read(void *data, size_t size) {
+        if (size > remaining()) {
+            return false;
+        }
+        memcpy(data, mPos, size);
+        mPos += size;
+        return true;
+    }
+    const uint8_t *mPos;
+    const uint8_t *mEnd;
+};
+
+// --------------- object encoding
+
+struct BinaryCodec {
+    template <typename E, typename = typename std::enable_if<std::is_enum<E>::value>::type>
+    static void write(ImageWriter *w, E e) {
+        w->writeU32(static_cast<uint32_t>(e));
+    }
+    // Enums are checked against the size of their string table.
+    template <typename E, size_t N>
+    static bool read(ImageReader *r, const std::array<std::string, N> &, E *e) {
+        uint32_t v;
+        if (!r->readU32(&v) || v >= N) {
+            return false;
+        }
+        *e = static_cast<E>(v);
+        return true;
+    }
+
+    static void write(ImageWriter *w, bool b) { w->writeU32(b ? 1 : 0); }
+    static bool read(ImageReader *r, bool *b) {
+        uint32_t v;
+        if (!r->readU32(&v) || v > 1) {
+            return false;
+        }
+        *b = v != 0;
+        return true;
+    }
+
+    static void write(ImageWriter *w, const std::string &s) { w->writeString(s); }
+    static bool read(ImageReader *r, std::string *s) { return r->readString(s); }
+
+    static void write(ImageWriter *w, const Version &v) {
+        w->writeU64(v.majorVer);
+        w->writeU64(v.minorVer);
+    }
+    static bool read(ImageReader *r, Version *v) {
+        return r->readSize(&v->majorVer) && r->readSize(&v->minorVer);
+    }
+
+    static void write(ImageWriter *w, const KernelVersion &v) {
+        w->writeU64(v.version);
+        w->writeU64(v.majorRev);
+        w->writeU64(v.minorRev);
+    }
+    static bool read(ImageReader *r, KernelVersion *v) {
+        return r->readSize(&v->version) && r->readSize(&v->majorRev) &&
+               r->readSize(&v->minorRev);
+    }
+
+    static void write(ImageWriter *w, const VersionRange &v) {
+        w->writeU64(v.majorVer);
+        w->writeU64(v.minMinor);
+        w->writeU64(v.maxMinor);
+    }
+    static bool read(ImageReader *r, VersionRange *v) {
+        return r->readSize(&v->majorVer) && r->readSize(&v->minMinor) &&
+               r->readSize(&v->maxMinor);
+    }
+
+    static void write(ImageWriter *w, const VndkVersionRange &v) {
+        w->writeU64(v.sdk);
+        w->writeU64(v.vndk);
+        w->writeU64(v.patchMin);
+        w->writeU64(v.patchMax);
+    }
+    static bool read(ImageReader *r, VndkVersionRange *v) {
+        return r->readSize(&v->sdk) && r->readSize(&v->vndk) && r->readSize(&v->patchMin) &&
+               r->readSize(&v->patchMax);
+    }
+
+    template <typename T>
+    static void write(ImageWriter *w, const std::vector<T> &v) {
+        w->writeU32(v.size());
+        for (const T &e : v) {
+            write(w, e);
+        }
+    }
+    template <typename T>
+    static bool read(ImageReader *r, std::vector<T> *v) {
+        uint32_t size;
+        if (!r->readU32(&size)) {
+            return false;
+        }
+        v->clear();
+        for (uint32_t i = 0; i < size; ++i) {
+            T e;
+            if (!read(r, &e)) {
+                return false;
+            }
+            v->push_back(std::move(e));
+        }
+        return true;
+    }
+
+    // Sets of std::string or InternedString.
+    template <typename E, typename Compare, typename Allocator>
+    static void write(ImageWriter *w, const std::set<E, Compare, Allocator> &s) {
+        w->writeU32(s.size());
+        for (const std::string &e : s) {
+            w->writeString(e);
+        }
+    }
+    template <typename E, typename Compare, typename Allocator>
+    static bool read(ImageReader *r, std::set<E, Compare, Allocator> *s) {
+        uint32_t size;
+        if (!r->readU32(&size)) {
+            return false;
+        }
+        s->clear();
+        for (uint32_t i = 0; i < size; ++i) {
+            E e;
+            if (!r->readString(&e)) {
+                return false;
+            }
+            s->emplace_hint(s->end(), std::move(e));
+        }
+        return true;
+    }
+
+    static void write(ImageWriter *w,
+                      const ArenaMap<InternedString, HalInterface, std::less<>> &interfaces) {
+        w->writeU32(interfaces.size());
+        for (const auto &pair : interfaces) {
+            w->writeString(pair.second.name);
+            write(w, pair.second.instances);
+        }
+    }
+    static bool read(ImageReader *r,
+                     ArenaMap<InternedString, HalInterface, std::less<>> *interfaces) {
+        uint32_t size;
+        if (!r->readU32(&size)) {
+            return false;
+        }
+        interfaces->clear();
+        for (uint32_t i = 0; i < size; ++i) {
+            HalInterface interface;
+            if (!r->readString(&interface.name) || !read(r, &interface.instances)) {
+                return false;
+            }
+            InternedString name = interface.name;
+            interfaces->emplace_hint(interfaces->end(), std::move(name), std::move(interface));
+        }
+        return true;
+    }
+
+    static void write(ImageWriter *w, const ManifestHal &hal) {
+        write(w, hal.format);
+        w->writeString(hal.name);
+        write(w, hal.versions);
+        write(w, hal.transportArch.transport);
+        write(w, hal.transportArch.arch);
+        write(w, hal.interfaces);
+    }
+    static bool read(ImageReader *r, ManifestHal *hal) {
+        return read(r, gHalFormatStrings, &hal->format) && r->readString(&hal->name) &&
+               read(r, &hal->versions) &&
+               read(r, gTransportStrings, &hal->transportArch.transport) &&
+               read(r, gArchStrings, &hal->transportArch.arch) && read(r, &hal->interfaces);
+    }
+
+    static void write(ImageWriter *w, const MatrixHal &hal) {
+        write(w, hal.format);
+        w->writeString(hal.name);
+        write(w, hal.versionRanges);
+        write(w, hal.optional);
+        write(w, hal.interfaces);
+    }
+    static bool read(ImageReader *r, MatrixHal *hal) {
+        return read(r, gHalFormatStrings, &hal->format) && r->readString(&hal->name) &&
+               read(r, &hal->versionRanges) && read(r, &hal->optional) &&
+               read(r, &hal->interfaces);
+    }
+
+    static void write(ImageWriter *w, const Vndk &vndk) {
+        write(w, vndk.mVersionRange);
+        write(w, vndk.mLibraries);
+    }
+    static bool read(ImageReader *r, Vndk *vndk) {
+        return read(r, &vndk->mVersionRange) && read(r, &vndk->mLibraries);
+    }
+
+    static void write(ImageWriter *w, const KernelConfigTypedValue &value) {
+        write(w, value.mType);
+        switch (value.mType) {
+            case KernelConfigType::STRING:
+                w->writeString(value.mStringValue);
+                break;
+            case KernelConfigType::INTEGER:
+                w->writeU64(value.mIntegerValue);
+                break;
+            case KernelConfigType::RANGE:
+                w->writeU64(value.mRangeValue.first);
+                w->writeU64(value.mRangeValue.second);
+                break;
+            case KernelConfigType::TRISTATE:
+                write(w, value.mTristateValue);
+                break;
+        }
+    }
+    static bool read(ImageReader *r, KernelConfigTypedValue *value) {
+        if (!read(r, gKernelConfigTypeStrings, &value->mType)) {
+            return false;
+        }
+        switch (value->mType) {
+            case KernelConfigType::STRING:
+                return r->readString(&value->mStringValue);
+            case KernelConfigType::INTEGER: {
+                uint64_t v;
+                if (!r->readU64(&v)) {
+                    return false;
+                }
+                value->mIntegerValue = static_cast<KernelConfigIntValue>(v);
+                return true;
+            }
+            case KernelConfigType::RANGE:
+                return r->readU64(&value->mRangeValue.first) &&
+                       r->readU64(&value->mRangeValue.second);
+            case KernelConfigType::TRISTATE:
+                return read(r, gTristateStrings, &value->mTristateValue);
+        }
+        return false;
+    }
+
+    static void write(ImageWriter *w, const KernelConfig &config) {
+        w->writeString(config.first);
+        write(w, config.second);
+    }
+    static bool read(ImageReader *r, KernelConfig *config) {
+        return r->readString(&config->first) && read(r, &config->second);
+    }
+
+    static void write(ImageWriter *w, const MatrixKernel &kernel) {
+        write(w, kernel.mMinLts);
+        write(w, kernel.mConfigs);
+        write(w, kernel.mConditions);
+    }
+    static bool read(ImageReader *r, MatrixKernel *kernel) {
+        return read(r, &kernel->mMinLts) && read(r, &kernel->mConfigs) &&
+               read(r, &kernel->mConditions);
+    }
+
+    static void write(ImageWriter *w, const Sepolicy &sepolicy) {
+        w->writeU64(sepolicy.mKernelSepolicyVersion.value);
+        write(w, sepolicy.mSepolicyVersionRanges);
+    }
+    static bool read(ImageReader *r, Sepolicy *sepolicy) {
+        return r->readSize(&sepolicy->mKernelSepolicyVersion.value) &&
+               read(r, &sepolicy->mSepolicyVersionRanges);
+    }
+
+    static void write(ImageWriter *w, const ManifestXmlFile &xmlFile) {
+        w->writeString(xmlFile.mName);
+        w->writeString(xmlFile.mOverriddenPath);
+        write(w, xmlFile.mVersion);
+    }
+    static bool read(ImageReader *r, ManifestXmlFile *xmlFile) {
+        return r->readString(&xmlFile->mName) && r->readString(&xmlFile->mOverriddenPath) &&
+               read(r, &xmlFile->mVersion);
+    }
+
+    static void write(ImageWriter *w, const MatrixXmlFile &xmlFile) {
+        w->writeString(xmlFile.mName);
+        w->writeString(xmlFile.mOverriddenPath);
+        write(w, xmlFile.mOptional);
+        write(w, xmlFile.mFormat);
+        write(w, xmlFile.mVersionRange);
+    }
+    static bool read(ImageReader *r, MatrixXmlFile *xmlFile) {
+        return r->readString(&xmlFile->mName) && r->readString(&xmlFile->mOverriddenPath) &&
+               read(r, &xmlFile->mOptional) &&
+               read(r, gXmlSchemaFormatStrings, &xmlFile->mFormat) &&
+               read(r, &xmlFile->mVersionRange);
+    }
+
+    // HALs and <xmlfile>s are added through addAll() and addXmlFile() so that the
+    // same checks as in the XML converters apply.
+    template <typename Group, typename T>
+    static bool readHals(ImageReader *r, Group *group) {
+        std::vector<T> hals;
+        return read(r, &hals) && group->addAll(std::move(hals));
+    }
+    template <typename Group, typename T>
+    static bool readXmlFiles(ImageReader *r, Group *group) {
+        std::vector<T> xmlFiles;
+        if (!read(r, &xmlFiles)) {
+            return false;
+        }
+        for (auto &&xmlFile : xmlFiles) {
+            if (!group->addXmlFile(std::move(xmlFile))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Write the values of a multimap in the same layout as a vector.
+    template <typename Iterable>
+    static void writeValues(ImageWriter *w, const Iterable &values) {
+        w->writeU32(std::distance(values.begin(), values.end()));
+        for (const auto &e : values) {
+            write(w, e);
+        }
+    }
+
+    static void write(ImageWriter *w, const HalManifest &m) {
+        write(w, m.mType);
+        writeValues(w, m.getHals());
+        write(w, m.device.mSepolicyVersion);
+        write(w, m.framework.mVndks);
+        writeValues(w, m.getXmlFiles());
+    }
+    static bool read(ImageReader *r, HalManifest *m) {
+        return read(r, gSchemaTypeStrings, &m->mType) &&
+               readHals<HalManifest, ManifestHal>(r, m) && read(r, &m->device.mSepolicyVersion) &&
+               read(r, &m->framework.mVndks) &&
+               readXmlFiles<HalManifest, ManifestXmlFile>(r, m);
+    }
+
+    static void write(ImageWriter *w, const CompatibilityMatrix &m) {
+        write(w, m.mType);
+        writeValues(w, iterateValues(m.mHals));
+        write(w, m.framework.mKernels);
+        write(w, m.framework.mSepolicy);
+        write(w, m.framework.mAvbMetaVersion);
+        write(w, m.device.mVndk);
+        writeValues(w, m.getXmlFiles());
+    }
+    static bool read(ImageReader *r, CompatibilityMatrix *m) {
+        return read(r, gSchemaTypeStrings, &m->mType) &&
+               readHals<CompatibilityMatrix, MatrixHal>(r, m) &&
+               read(r, &m->framework.mKernels) && read(r, &m->framework.mSepolicy) &&
+               read(r, &m->framework.mAvbMetaVersion) && read(r, &m->device.mVndk) &&
+               readXmlFiles<CompatibilityMatrix, MatrixXmlFile>(r, m);
+    }
+};
+
+// --------------- converters
+
+template <typename Object, ImageKind kind>
+struct BinaryImageConverter : public BinaryConverter<Object> {
+    const std::string &lastError() const override { return mLastError; }
+
+    std::string serialize(const Object &o, const std::string &sourceXml) const override {
+        ImageWriter payload;
+        BinaryCodec::write(&payload, o);
+
+        ImageHeader header;
+        memcpy(header.magic, kImageMagic, sizeof(header.magic));
+        header.formatVersion = kImageFormatVersion;
+        header.kind = static_cast<uint32_t>(kind);
+        header.sourceSize = sourceXml.size();
+        header.sourceHash = hashSource(sourceXml);
+        header.payloadSize = payload.buffer().size();
+
+        std::string image(reinterpret_cast<const char *>(&header), sizeof(header));
+        image += payload.buffer();
+        return image;
+    }
+
+    bool deserialize(Object *o, const void *data, size_t size,
+                     const std::string &sourceXml) const override {
+        ImageHeader header;
+        if (size < sizeof(header)) {
+            mLastError = "Image is truncated";
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, kImageMagic, sizeof(header.magic)) != 0 ||
+            header.kind != static_cast<uint32_t>(kind)) {
+            mLastError = "Not a valid image of this type";
+            return false;
+        }
+        if (header.formatVersion != kImageFormatVersion) {
+            mLastError =
+                "Unrecognized image format version " + std::to_string(header.formatVersion);
+            return false;
+        }
+        if (header.payloadSize != size - sizeof(header)) {
+            mLastError = "Image is truncated";
+            return false;
+        }
+        if (header.sourceSize != sourceXml.size() || header.sourceHash != hashSource(sourceXml)) {
+            mLastError = "Image is stale";
+            return false;
+        }
+
+        const uint8_t *payload = static_cast<const uint8_t *>(data) + sizeof(header);
+        ImageReader reader(payload, payload + header.payloadSize);
+        // Like parsing the XML, build the object graph in an arena. The object is moved
+        // into o, so o takes over the arena.
+        ArenaScope arenaScope;
+        Object object;
+        if (!BinaryCodec::read(&reader, &object) || !reader.atEnd()) {
+            mLastError = "Image is malformed";
+            return false;
+        }
+        *o = std::move(object);
+        return true;
+    }
+
+   private:
+    mutable details::PerThreadString mLastError;
+};
+
+std::string binaryImagePath(const std::string &xmlPath) {
+    return xmlPath + ".bin";
+}
+
+static const BinaryImageConverter<HalManifest, ImageKind::HAL_MANIFEST>
+    halManifestBinaryConverter{};
+static const BinaryImageConverter<CompatibilityMatrix, ImageKind::COMPATIBILITY_MATRIX>
+    compatibilityMatrixBinaryConverter{};
+
+const BinaryConverter<HalManifest> &gHalManifestBinaryConverter = halManifestBinaryConverter;
+const BinaryConverter<CompatibilityMatrix> &gCompatibilityMatrixBinaryConverter =
+    compatibilityMatrixBinaryConverter;
+
+} // namespace vintf
+} // namespace android
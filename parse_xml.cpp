@@ -21,11 +21,20 @@
 
 #include "parse_xml.h"
 
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <ostream>
 #include <type_traits>
 
 #include <tinyxml2.h>
 
+#include "Arena.h"
 #include "parse_string.h"
+#include "utils.h"
 
 namespace android {
 namespace vintf {
@@ -35,11 +44,6 @@ namespace vintf {
 using NodeType = tinyxml2::XMLElement;
 using DocType = tinyxml2::XMLDocument;
 
-// caller is responsible for deleteDocument() call
-inline DocType *createDocument() {
-    return new tinyxml2::XMLDocument();
-}
-
 // caller is responsible for deleteDocument() call
 inline DocType *createDocument(const std::string &xml) {
     DocType *doc = new tinyxml2::XMLDocument();
@@ -54,33 +58,6 @@ inline void deleteDocument(DocType *d) {
     delete d;
 }
 
-inline std::string printDocument(DocType *d) {
-    tinyxml2::XMLPrinter p;
-    d->Print(&p);
-    return std::string{p.CStr()};
-}
-
-inline NodeType *createNode(const std::string &name, DocType *d) {
-    return d->NewElement(name.c_str());
-}
-
-inline void appendChild(NodeType *parent, NodeType *child) {
-    parent->InsertEndChild(child);
-}
-
-inline void appendChild(DocType *parent, NodeType *child) {
-    parent->InsertEndChild(child);
-}
-
-inline void appendStrAttr(NodeType *e, const std::string &attrName, const std::string &attr) {
-    e->SetAttribute(attrName.c_str(), attr.c_str());
-}
-
-// text -> text
-inline void appendText(NodeType *parent, const std::string &text, DocType *d) {
-    parent->InsertEndChild(d->NewText(text.c_str()));
-}
-
 inline std::string nameOf(NodeType *root) {
     return root->Name() == NULL ? "" : root->Name();
 }
@@ -117,6 +94,608 @@ inline bool getAttr(NodeType *root, const std::string &attrName, std::string *s)
 
 // --------------- tinyxml2 details end.
 
+// --------------- streaming XML reader
+
+// Reads an XML document in a single pass without building a DOM. Text and
+// attribute values are decoded the same way tinyxml2 decodes them: entities and
+// character references are expanded, line breaks are normalized to '\n', and
+// text that consists only of whitespace is dropped.
+class XmlPullParser {
+   public:
+    enum Event {
+        START_ELEMENT,  // name() and attributes() are set
+        END_ELEMENT,
+        TEXT,   // text() is set
+        OTHER,  // comment, declaration or DTD
+        END_DOCUMENT,
+        ERROR,
+    };
+
+    // Like tinyxml2, the document ends at the first NUL character.
+    explicit XmlPullParser(const std::string &xml)
+        : mPos(xml.c_str()), mEnd(xml.c_str() + strlen(xml.c_str())) {
+        static const char kBom[] = "\xEF\xBB\xBF";
+        if (startsWith(kBom)) {
+            mPos += strlen(kBom);
+        }
+    }
+
+    Event next() {
+        if (mFailed) {
+            return ERROR;
+        }
+        if (mPendingEnd) {
+            mPendingEnd = false;
+            mOpenElements.pop_back();
+            return END_ELEMENT;
+        }
+        const char *start = mPos;
+        skipWhitespace();
+        if (mPos == mEnd) {
+            return mOpenElements.empty() ? END_DOCUMENT : fail();
+        }
+        if (*mPos != '<') {
+            // Leading whitespace is part of the text.
+            const char *textEnd = std::find(mPos, mEnd, '<');
+            if (textEnd == mEnd) {
+                return fail();
+            }
+            decode(start, textEnd, true /* entities */, &mText);
+            mPos = textEnd;
+            return TEXT;
+        }
+        if (startsWith("<?")) {
+            return skipPast("?>") ? OTHER : fail();
+        }
+        if (startsWith("<!--")) {
+            return skipPast("-->") ? OTHER : fail();
+        }
+        if (startsWith("<![CDATA[")) {
+            const char *textStart = mPos + strlen("<![CDATA[");
+            if (!skipPast("]]>")) {
+                return fail();
+            }
+            decode(textStart, mPos - strlen("]]>"), false /* entities */, &mText);
+            return TEXT;
+        }
+        if (startsWith("<!")) {
+            return skipPast(">") ? OTHER : fail();
+        }
+        ++mPos;
+        skipWhitespace();
+        if (mPos != mEnd && *mPos == '/') {
+            return readEndTag();
+        }
+        return readStartTag();
+    }
+
+    // Skip the rest of the current element, including its end tag.
+    bool skipElement() {
+        size_t depth = mOpenElements.size();
+        while (mOpenElements.size() >= depth) {
+            Event event = next();
+            if (event == END_DOCUMENT || event == ERROR) {
+                return fail(), false;
+            }
+        }
+        return true;
+    }
+
+    // Skip to the end of the document.
+    bool skipDocument() {
+        for (;;) {
+            Event event = next();
+            if (event == END_DOCUMENT) return true;
+            if (event == ERROR) return false;
+        }
+    }
+
+    inline bool nameIs(const std::string &name) const {
+        const auto &current = mOpenElements.back();
+        return current.second == name.size() &&
+               memcmp(current.first, name.data(), name.size()) == 0;
+    }
+    inline const std::vector<std::pair<std::string, std::string>> &attributes() const {
+        return mAttributes;
+    }
+    inline const std::string &text() const { return mText; }
+    inline size_t depth() const { return mOpenElements.size(); }
+    inline std::string name() const {
+        const auto &current = mOpenElements.back();
+        return std::string(current.first, current.second);
+    }
+    inline bool failed() const { return mFailed; }
+
+   private:
+    static inline bool isWhitespace(char c) {
+        return static_cast<unsigned char>(c) < 128 && isspace(static_cast<unsigned char>(c));
+    }
+    static inline bool isNameStartChar(char c) {
+        return static_cast<unsigned char>(c) >= 128 || isalpha(static_cast<unsigned char>(c)) ||
+               c == ':' || c == '_';
+    }
+    static inline bool isNameChar(char c) {
+        return isNameStartChar(c) || isdigit(static_cast<unsigned char>(c)) || c == '.' ||
+               c == '-';
+    }
+
+    inline Event fail() {
+        mFailed = true;
+        return ERROR;
+    }
+    inline void skipWhitespace() {
+        while (mPos != mEnd && isWhitespace(*mPos)) ++mPos;
+    }
+    inline bool startsWith(const char *s) const {
+        size_t len = strlen(s);
+        return static_cast<size_t>(mEnd - mPos) >= len && memcmp(mPos, s, len) == 0;
+    }
+    // Move past the next occurrence of s.
+    inline bool skipPast(const char *s) {
+        size_t len = strlen(s);
+        const char *found = std::search(mPos, mEnd, s, s + len);
+        if (found == mEnd) {
+            return false;
+        }
+        mPos = found + len;
+        return true;
+    }
+    inline bool readName(const char **name, size_t *len) {
+        if (mPos == mEnd || !isNameStartChar(*mPos)) {
+            return false;
+        }
+        *name = mPos;
+        while (mPos != mEnd && isNameChar(*mPos)) ++mPos;
+        *len = mPos - *name;
+        return true;
+    }
+
+    Event readStartTag() {
+        const char *name;
+        size_t len;
+        if (!readName(&name, &len)) {
+            return fail();
+        }
+        mAttributes.clear();
+        for (;;) {
+            skipWhitespace();
+            if (mPos == mEnd) {
+                return fail();
+            }
+            if (*mPos == '>') {
+                ++mPos;
+                break;
+            }
+            if (*mPos == '/') {
+                if (mEnd - mPos < 2 || mPos[1] != '>') {
+                    return fail();
+                }
+                mPos += 2;
+                mPendingEnd = true;
+                break;
+            }
+            if (!readAttribute()) {
+                return fail();
+            }
+        }
+        mOpenElements.emplace_back(name, len);
+        return START_ELEMENT;
+    }
+
+    bool readAttribute() {
+        const char *name;
+        size_t len;
+        if (!readName(&name, &len)) {
+            return false;
+        }
+        skipWhitespace();
+        if (mPos == mEnd || *mPos != '=') {
+            return false;
+        }
+        ++mPos;
+        skipWhitespace();
+        if (mPos == mEnd || (*mPos != '"' && *mPos != '\'')) {
+            return false;
+        }
+        const char *valueStart = ++mPos;
+        const char *valueEnd = std::find(mPos, mEnd, mPos[-1]);
+        if (valueEnd == mEnd) {
+            return false;
+        }
+        mPos = valueEnd + 1;
+        for (const auto &attr : mAttributes) {
+            if (attr.first.size() == len && memcmp(attr.first.data(), name, len) == 0) {
+                return false;  // duplicated attribute
+            }
+        }
+        mAttributes.emplace_back(std::string(name, len), std::string());
+        decode(valueStart, valueEnd, true /* entities */, &mAttributes.back().second);
+        return true;
+    }
+
+    Event readEndTag() {
+        ++mPos;
+        const char *name;
+        size_t len;
+        if (!readName(&name, &len) || mOpenElements.empty()) {
+            return fail();
+        }
+        const auto &open = mOpenElements.back();
+        if (open.second != len || memcmp(open.first, name, len) != 0) {
+            return fail();
+        }
+        skipWhitespace();
+        if (mPos == mEnd || *mPos != '>') {
+            return fail();
+        }
+        ++mPos;
+        mOpenElements.pop_back();
+        return END_ELEMENT;
+    }
+
+    // Append the UTF-8 encoding of c to out.
+    static void appendUtf8(unsigned long c, std::string *out) {
+        if (c < 0x80) {
+            out->push_back(c);
+        } else if (c < 0x800) {
+            out->push_back(0xC0 | (c >> 6));
+            out->push_back(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out->push_back(0xE0 | (c >> 12));
+            out->push_back(0x80 | ((c >> 6) & 0x3F));
+            out->push_back(0x80 | (c & 0x3F));
+        } else if (c < 0x200000) {
+            out->push_back(0xF0 | (c >> 18));
+            out->push_back(0x80 | ((c >> 12) & 0x3F));
+            out->push_back(0x80 | ((c >> 6) & 0x3F));
+            out->push_back(0x80 | (c & 0x3F));
+        }
+    }
+
+    // Decode the character reference at p ("&#...;" or "&#x...;"), which ends
+    // before end. Return the position after it, or nullptr if it is malformed.
+    static const char *decodeCharacterRef(const char *p, const char *end, std::string *out) {
+        bool hex = end - p > 2 && p[2] == 'x';
+        const char *digits = p + (hex ? 3 : 2);
+        const char *semicolon = std::find(digits, end, ';');
+        if (semicolon == end || semicolon == digits) {
+            return nullptr;
+        }
+        unsigned long c = 0;
+        for (const char *q = digits; q != semicolon; ++q) {
+            int digit;
+            if (*q >= '0' && *q <= '9') {
+                digit = *q - '0';
+            } else if (hex && *q >= 'a' && *q <= 'f') {
+                digit = *q - 'a' + 10;
+            } else if (hex && *q >= 'A' && *q <= 'F') {
+                digit = *q - 'A' + 10;
+            } else {
+                return nullptr;
+            }
+            c = c * (hex ? 16 : 10) + digit;
+        }
+        appendUtf8(c, out);
+        return semicolon + 1;
+    }
+
+    // Decode [begin, end) into out.
+    static void decode(const char *begin, const char *end, bool entities, std::string *out) {
+        out->clear();
+        const char *p = begin;
+        while (p != end) {
+            const char *special = p;
+            while (special != end && *special != '\r' && *special != '\n' &&
+                   !(entities && *special == '&')) {
+                ++special;
+            }
+            out->append(p, special);
+            if (special == end) {
+                break;
+            }
+            p = special;
+            if (*p == '\r' || *p == '\n') {
+                char other = *p == '\r' ? '\n' : '\r';
+                p += (end - p > 1 && p[1] == other) ? 2 : 1;
+                out->push_back('\n');
+                continue;
+            }
+            // *p == '&'
+            if (end - p > 1 && p[1] == '#') {
+                const char *next = decodeCharacterRef(p, end, out);
+                if (next != nullptr) {
+                    p = next;
+                    continue;
+                }
+            } else {
+                static const std::pair<const char *, char> kEntities[] = {
+                    {"quot;", '"'}, {"amp;", '&'}, {"apos;", '\''}, {"lt;", '<'}, {"gt;", '>'}};
+                bool found = false;
+                for (const auto &entity : kEntities) {
+                    size_t len = strlen(entity.first);
+                    if (static_cast<size_t>(end - p - 1) >= len &&
+                        memcmp(p + 1, entity.first, len) == 0) {
+                        out->push_back(entity.second);
+                        p += len + 1;
+                        found = true;
+                        break;
+                    }
+                }
+                if (found) {
+                    continue;
+                }
+            }
+            out->push_back('&');
+            ++p;
+        }
+    }
+
+    const char *mPos;
+    const char *const mEnd;
+    bool mFailed = false;
+    // Set when the current start tag is self-closing.
+    bool mPendingEnd = false;
+    // Names of open elements, pointing into the document.
+    std::vector<std::pair<const char *, size_t>> mOpenElements;
+    std::vector<std::pair<std::string, std::string>> mAttributes;
+    std::string mText;
+};
+
+// Collects the results of child elements with a given name in streaming mode.
+// See XmlStreamElement::readContent.
+class XmlStreamSlot {
+   public:
+    XmlStreamSlot(std::string &&name, const void *converter)
+        : mName(std::move(name)), mConverter(converter) {}
+    virtual ~XmlStreamSlot() {}
+    inline const std::string &name() const { return mName; }
+    // The converter that builds the child elements, or nullptr for text elements.
+    inline const void *converter() const { return mConverter; }
+    // Read a child element whose start tag has just been read, up to and
+    // including its end tag. Return false only if the XML is not valid.
+    virtual bool read(XmlPullParser *parser) = 0;
+
+   private:
+    std::string mName;
+    const void *mConverter;
+};
+
+// An element in streaming mode. It is created right after the parser reads its
+// start tag.
+class XmlStreamElement {
+   public:
+    explicit XmlStreamElement(XmlPullParser *parser)
+        : mParser(parser), mAttributes(parser->attributes()) {}
+
+    // Read the rest of this element, including its end tag. Each child element
+    // is passed to the slot with the same name, and the others are skipped. The
+    // slots must stay alive while the element is used. For the root element,
+    // the rest of the document is read as well. Return false if the XML is not
+    // valid.
+    bool readContent(std::initializer_list<XmlStreamSlot *> slots) {
+        mSlots.assign(slots.begin(), slots.end());
+        bool firstNode = true;
+        for (;; firstNode = false) {
+            switch (mParser->next()) {
+                case XmlPullParser::TEXT: {
+                    if (firstNode) {
+                        mText = mParser->text();
+                    }
+                } break;
+                case XmlPullParser::OTHER: {
+                } break;
+                case XmlPullParser::START_ELEMENT: {
+                    auto it = std::find_if(mSlots.begin(), mSlots.end(), [this](auto *slot) {
+                        return mParser->nameIs(slot->name());
+                    });
+                    bool success = it == mSlots.end() ? mParser->skipElement()
+                                                      : (*it)->read(mParser);
+                    if (!success) {
+                        return false;
+                    }
+                } break;
+                case XmlPullParser::END_ELEMENT: {
+                    return mParser->depth() > 0 || mParser->skipDocument();
+                }
+                case XmlPullParser::END_DOCUMENT:
+                case XmlPullParser::ERROR: {
+                    return false;
+                }
+            }
+        }
+    }
+
+    // The text of the element if its first child node is text, like
+    // tinyxml2::XMLElement::GetText(). Set by readContent.
+    inline const std::string &text() const { return mText; }
+
+    inline const char *attribute(const std::string &name) const {
+        for (const auto &attr : mAttributes) {
+            if (attr.first == name) {
+                return attr.second.c_str();
+            }
+        }
+        return nullptr;
+    }
+
+    // Return the slot passed to readContent that matches the given name and converter.
+    XmlStreamSlot *slot(const std::string &name, const void *converter) const {
+        for (XmlStreamSlot *slot : mSlots) {
+            if (slot->converter() == converter && slot->name() == name) {
+                return slot;
+            }
+        }
+        LOG(FATAL) << "No slot for element <" << name << ">";
+        return nullptr;
+    }
+
+   private:
+    XmlPullParser *mParser;
+    std::vector<std::pair<std::string, std::string>> mAttributes;
+    std::vector<XmlStreamSlot *> mSlots;
+    std::string mText;
+};
+
+// Collects the text of <name> child elements.
+class XmlStreamTexts : public XmlStreamSlot {
+   public:
+    explicit XmlStreamTexts(std::string &&name) : XmlStreamSlot(std::move(name), nullptr) {}
+    bool read(XmlPullParser *parser) override {
+        XmlStreamElement child(parser);
+        if (!child.readContent({})) {
+            return false;
+        }
+        mTexts.push_back(child.text());
+        return true;
+    }
+    inline std::vector<std::string> &texts() { return mTexts; }
+
+   private:
+    std::vector<std::string> mTexts;
+};
+
+inline std::string getText(XmlStreamElement *root) {
+    return root->text();
+}
+
+inline bool getAttr(XmlStreamElement *root, const std::string &attrName, std::string *s) {
+    const char *c = root->attribute(attrName);
+    if (c == NULL)
+        return false;
+    *s = c;
+    return true;
+}
+
+// --------------- streaming XML reader end.
+
+// --------------- streaming XML writer
+
+// Writes XML in the same format as tinyxml2::XMLPrinter: each element starts on a
+// new line indented by four spaces per level, an element that only has text is
+// written on one line, and an empty element is written as <name/>. Attributes of
+// an element must be written before its content. The output is appended to a
+// string, or written to a stream in chunks.
+class XmlWriter {
+   public:
+    explicit XmlWriter(std::string *out) : mOut(out) {}
+    explicit XmlWriter(std::ostream *stream) : mOut(&mBuffer), mStream(stream) {}
+    XmlWriter(const XmlWriter &) = delete;
+    XmlWriter &operator=(const XmlWriter &) = delete;
+    ~XmlWriter() { flush(); }
+
+    void startElement(const std::string &name) {
+        sealElement();
+        mOpenElements.push_back(name);
+        if (mTextDepth < 0 && !mFirstElement) {
+            mOut->push_back('\n');
+        }
+        mOut->append(4 * mDepth, ' ');
+        mOut->push_back('<');
+        mOut->append(name);
+        mElementJustOpened = true;
+        mFirstElement = false;
+        ++mDepth;
+    }
+
+    void attribute(const std::string &name, const std::string &value) {
+        CHECK(mElementJustOpened) << "Attribute " << name << " written after content";
+        mOut->push_back(' ');
+        mOut->append(name);
+        mOut->append("=\"");
+        appendEscaped(value, false /* isText */);
+        mOut->push_back('"');
+    }
+
+    void text(const std::string &text) {
+        mTextDepth = mDepth - 1;
+        sealElement();
+        appendEscaped(text, true /* isText */);
+    }
+
+    void endElement() {
+        --mDepth;
+        if (mElementJustOpened) {
+            mOut->append("/>");
+        } else {
+            if (mTextDepth < 0) {
+                mOut->push_back('\n');
+                mOut->append(4 * mDepth, ' ');
+            }
+            mOut->append("</");
+            mOut->append(mOpenElements.back());
+            mOut->push_back('>');
+        }
+        mOpenElements.pop_back();
+        if (mTextDepth == mDepth) {
+            mTextDepth = -1;
+        }
+        if (mDepth == 0) {
+            mOut->push_back('\n');
+        }
+        mElementJustOpened = false;
+        if (mStream != nullptr && mBuffer.size() >= kFlushSize) {
+            flush();
+        }
+    }
+
+   private:
+    static constexpr size_t kFlushSize = 65536;
+
+    void sealElement() {
+        if (mElementJustOpened) {
+            mElementJustOpened = false;
+            mOut->push_back('>');
+        }
+    }
+
+    // Like tinyxml2, quotes are only escaped in attribute values.
+    void appendEscaped(const std::string &s, bool isText) {
+        for (char c : s) {
+            switch (c) {
+                case '&': mOut->append("&amp;"); break;
+                case '<': mOut->append("&lt;"); break;
+                case '>': mOut->append("&gt;"); break;
+                case '"':
+                    if (isText) {
+                        mOut->push_back(c);
+                    } else {
+                        mOut->append("&quot;");
+                    }
+                    break;
+                case '\'':
+                    if (isText) {
+                        mOut->push_back(c);
+                    } else {
+                        mOut->append("&apos;");
+                    }
+                    break;
+                default: mOut->push_back(c); break;
+            }
+        }
+    }
+
+    void flush() {
+        if (mStream != nullptr) {
+            mStream->write(mBuffer.data(), mBuffer.size());
+            mBuffer.clear();
+        }
+    }
+
+    std::string *mOut;
+    std::string mBuffer;
+    std::ostream *mStream = nullptr;
+    std::vector<std::string> mOpenElements;
+    int mDepth = 0;
+    // Depth of the element whose text was written last, or -1.
+    int mTextDepth = -1;
+    bool mElementJustOpened = false;
+    bool mFirstElement = true;
+};
+
+constexpr size_t XmlWriter::kFlushSize;
+
+// --------------- streaming XML writer end.
+
 // Helper functions for XmlConverter
 static bool parse(const std::string &attrText, bool *attr) {
     if (attrText == "true" || attrText == "1") {
@@ -132,28 +711,42 @@ static bool parse(const std::string &attrText, bool *attr) {
 
 // ---------------------- XmlNodeConverter definitions
 
+template <typename T>
+class XmlStreamChildren;
+
 template<typename Object>
 struct XmlNodeConverter : public XmlConverter<Object> {
     XmlNodeConverter() {}
     virtual ~XmlNodeConverter() {}
 
     // sub-types should implement these.
-    virtual void mutateNode(const Object &o, NodeType *n, DocType *d) const = 0;
+    // Write the attributes and then the content of the element for o.
+    virtual void mutateNode(const Object &o, XmlWriter *w) const = 0;
     virtual bool buildObject(Object *o, NodeType *n) const = 0;
+    // Same as buildObject, but for an element whose start tag has just been
+    // read. Implementations call root->readContent() and then the parse*
+    // functions in the same order as buildObject.
+    virtual bool streamObject(Object *o, XmlStreamElement *root) const = 0;
     virtual std::string elementName() const = 0;
 
     // convenience methods for user
     inline const std::string &lastError() const { return mLastError; }
-    inline NodeType *serialize(const Object &o, DocType *d) const {
-        NodeType *root = createNode(this->elementName(), d);
-        this->mutateNode(o, root, d);
-        return root;
-    }
-    inline std::string serialize(const Object &o) const {
-        DocType *doc = createDocument();
-        appendChild(doc, serialize(o, doc));
-        std::string s = printDocument(doc);
-        deleteDocument(doc);
+    inline void serialize(const Object &o, XmlWriter *w) const {
+        w->startElement(this->elementName());
+        this->mutateNode(o, w);
+        w->endElement();
+    }
+    inline void serialize(const Object &o, std::string *out) const override {
+        XmlWriter w(out);
+        serialize(o, &w);
+    }
+    inline void serialize(const Object &o, std::ostream &out) const override {
+        XmlWriter w(&out);
+        serialize(o, &w);
+    }
+    inline std::string serialize(const Object &o) const override {
+        std::string s;
+        serialize(o, &s);
         return s;
     }
     inline bool deserialize(Object *object, NodeType *root) const {
@@ -162,18 +755,43 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         }
         return this->buildObject(object, root);
     }
+    // The containers of the objects created while the XML is read allocate from an
+    // arena that is freed with the last of them.
     inline bool deserialize(Object *o, const std::string &xml) const {
         DocType *doc = createDocument(xml);
         if (doc == nullptr) {
             this->mLastError = "Not a valid XML";
             return false;
         }
+        ArenaScope arenaScope;
         bool ret = deserialize(o, getRootChild(doc));
         deleteDocument(doc);
         return ret;
     }
-    inline NodeType *operator()(const Object &o, DocType *d) const {
-        return serialize(o, d);
+    // Same as deserialize(o, xml), but reads the XML in a single pass without
+    // building a DOM.
+    bool deserializeStreaming(Object *o, const std::string &xml) const {
+        ArenaScope arenaScope;
+        XmlPullParser parser(xml);
+        XmlPullParser::Event event;
+        do {
+            event = parser.next();
+        } while (event == XmlPullParser::OTHER || event == XmlPullParser::TEXT);
+        bool ret = false;
+        if (event == XmlPullParser::START_ELEMENT) {
+            XmlStreamElement root(&parser);
+            if (parser.nameIs(this->elementName())) {
+                ret = this->streamObject(o, &root);
+            } else {
+                // Still check that the rest of the document is valid.
+                root.readContent({});
+            }
+        }
+        if (event != XmlPullParser::START_ELEMENT || parser.failed()) {
+            this->mLastError = "Not a valid XML";
+            return false;
+        }
+        return ret;
     }
     inline std::string operator()(const Object &o) const {
         return serialize(o);
@@ -188,47 +806,56 @@ struct XmlNodeConverter : public XmlConverter<Object> {
     // convenience methods for implementor.
 
     // All append* functions helps mutateNode() to serialize the object into XML.
+    // Attributes must be appended first.
     template <typename T>
-    inline void appendAttr(NodeType *e, const std::string &attrName, const T &attr) const {
-        return appendStrAttr(e, attrName, ::android::vintf::to_string(attr));
+    inline void appendAttr(XmlWriter *w, const std::string &attrName, const T &attr) const {
+        w->attribute(attrName, ::android::vintf::to_string(attr));
     }
 
-    inline void appendAttr(NodeType *e, const std::string &attrName, bool attr) const {
-        return appendStrAttr(e, attrName, attr ? "true" : "false");
+    inline void appendAttr(XmlWriter *w, const std::string &attrName, bool attr) const {
+        w->attribute(attrName, attr ? "true" : "false");
     }
 
+    // text -> text
+    inline void appendText(XmlWriter *w, const std::string &text) const { w->text(text); }
+
     // text -> <name>text</name>
-    inline void appendTextElement(NodeType *parent, const std::string &name,
-                const std::string &text, DocType *d) const {
-        NodeType *c = createNode(name, d);
-        appendText(c, text, d);
-        appendChild(parent, c);
+    inline void appendTextElement(XmlWriter *w, const std::string &name,
+                                  const std::string &text) const {
+        w->startElement(name);
+        w->text(text);
+        w->endElement();
     }
 
     // text -> <name>text</name>
     template<typename Array>
-    inline void appendTextElements(NodeType *parent, const std::string &name,
-                const Array &array, DocType *d) const {
+    inline void appendTextElements(XmlWriter *w, const std::string &name,
+                                   const Array &array) const {
         for (const std::string &text : array) {
-            NodeType *c = createNode(name, d);
-            appendText(c, text, d);
-            appendChild(parent, c);
+            appendTextElement(w, name, text);
         }
     }
 
+    // T is deduced from conv only, so that t may be converted to T.
+    template <typename T>
+    inline void appendChild(XmlWriter *w, const XmlNodeConverter<T> &conv,
+                            const typename std::decay<T>::type &t) const {
+        conv.serialize(t, w);
+    }
+
     template<typename T, typename Array>
-    inline void appendChildren(NodeType *parent, const XmlNodeConverter<T> &conv,
-            const Array &array, DocType *d) const {
+    inline void appendChildren(XmlWriter *w, const XmlNodeConverter<T> &conv,
+                               const Array &array) const {
         for (const T &t : array) {
-            appendChild(parent, conv(t, d));
+            conv.serialize(t, w);
         }
     }
 
     // All parse* functions helps buildObject() to deserialize XML to the object. Returns
     // true if deserialization is successful, false if any error, and mLastError will be
     // set to error message.
-    template <typename T>
-    inline bool parseOptionalAttr(NodeType *root, const std::string &attrName,
+    template <typename Node, typename T>
+    inline bool parseOptionalAttr(Node *root, const std::string &attrName,
             T &&defaultValue, T *attr) const {
         std::string attrText;
         bool success = getAttr(root, attrName, &attrText) &&
@@ -239,8 +866,8 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         return true;
     }
 
-    template <typename T>
-    inline bool parseAttr(NodeType *root, const std::string &attrName, T *attr) const {
+    template <typename Node, typename T>
+    inline bool parseAttr(Node *root, const std::string &attrName, T *attr) const {
         std::string attrText;
         bool ret = getAttr(root, attrName, &attrText) && ::android::vintf::parse(attrText, attr);
         if (!ret) {
@@ -250,7 +877,8 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         return ret;
     }
 
-    inline bool parseAttr(NodeType *root, const std::string &attrName, std::string *attr) const {
+    template <typename Node>
+    inline bool parseAttr(Node *root, const std::string &attrName, std::string *attr) const {
         bool ret = getAttr(root, attrName, attr);
         if (!ret) {
             mLastError = "Could not find attr with name \"" + attrName + "\" for element <"
@@ -271,6 +899,17 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         return true;
     }
 
+    template <typename Root>
+    inline bool parseTextElement(Root *root, const std::string &elementName,
+                                 InternedString *s) const {
+        std::string value;
+        if (!parseTextElement(root, elementName, &value)) {
+            return false;
+        }
+        *s = value;
+        return true;
+    }
+
     inline bool parseOptionalTextElement(NodeType* root, const std::string& elementName,
                                          std::string&& defaultValue, std::string* s) const {
         NodeType* child = getChild(root, elementName);
@@ -332,8 +971,9 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         return true;
     }
 
-    template <typename T>
-    inline bool parseChildren(NodeType *root, const XmlNodeConverter<T> &conv, std::set<T> *s) const {
+    template <typename Node, typename T, typename Compare, typename Allocator>
+    inline bool parseChildren(Node *root, const XmlNodeConverter<T> &conv,
+                              std::set<T, Compare, Allocator> *s) const {
         std::vector<T> vec;
         if (!parseChildren(root, conv, &vec)) {
             return false;
@@ -349,13 +989,82 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         return true;
     }
 
-    inline bool parseText(NodeType *node, std::string *s) const {
-        *s = getText(node);
+    // Overloads of the above for streaming mode. Child elements are looked up
+    // in the slots that are passed to root->readContent().
+    inline bool parseTextElement(XmlStreamElement *root, const std::string &elementName,
+                                 std::string *s) const {
+        auto &texts = static_cast<XmlStreamTexts *>(root->slot(elementName, nullptr))->texts();
+        if (texts.empty()) {
+            mLastError = "Could not find element with name <" + elementName + "> in element <"
+                    + this->elementName() + ">";
+            return false;
+        }
+        *s = std::move(texts.front());
+        return true;
+    }
+
+    inline bool parseOptionalTextElement(XmlStreamElement *root, const std::string &elementName,
+                                         std::string &&defaultValue, std::string *s) const {
+        auto &texts = static_cast<XmlStreamTexts *>(root->slot(elementName, nullptr))->texts();
+        *s = texts.empty() ? std::move(defaultValue) : std::move(texts.front());
+        return true;
+    }
+
+    inline bool parseTextElements(XmlStreamElement *root, const std::string &elementName,
+                                  std::vector<std::string> *v) const {
+        *v = std::move(static_cast<XmlStreamTexts *>(root->slot(elementName, nullptr))->texts());
         return true;
     }
 
     template <typename T>
-    inline bool parseText(NodeType *node, T *s) const {
+    inline bool parseChild(XmlStreamElement *root, const XmlNodeConverter<T> &conv, T *t) const {
+        auto *slot = static_cast<XmlStreamChildren<T> *>(root->slot(conv.elementName(), &conv));
+        if (slot->failed()) {
+            mLastError = slot->error();
+            return false;
+        }
+        if (slot->values().empty()) {
+            mLastError = "Could not find element with name <" + conv.elementName()
+                    + "> in element <" + this->elementName() + ">";
+            return false;
+        }
+        *t = std::move(slot->values().front());
+        return true;
+    }
+
+    template <typename T>
+    inline bool parseOptionalChild(XmlStreamElement *root, const XmlNodeConverter<T> &conv,
+            T &&defaultValue, T *t) const {
+        auto *slot = static_cast<XmlStreamChildren<T> *>(root->slot(conv.elementName(), &conv));
+        if (slot->failed()) {
+            mLastError = slot->error();
+            return false;
+        }
+        *t = slot->values().empty() ? std::move(defaultValue) : std::move(slot->values().front());
+        return true;
+    }
+
+    template <typename T>
+    inline bool parseChildren(XmlStreamElement *root, const XmlNodeConverter<T> &conv,
+            std::vector<T> *v) const {
+        auto *slot = static_cast<XmlStreamChildren<T> *>(root->slot(conv.elementName(), &conv));
+        if (slot->failed()) {
+            mLastError = "Could not parse element with name <" + conv.elementName()
+                    + "> in element <" + this->elementName() + ">: " + slot->error();
+            return false;
+        }
+        *v = std::move(slot->values());
+        return true;
+    }
+
+    template <typename Node>
+    inline bool parseText(Node *node, std::string *s) const {
+        *s = getText(node);
+        return true;
+    }
+
+    template <typename Node, typename T>
+    inline bool parseText(Node *node, T *s) const {
         std::string text = getText(node);
         bool ret = ::android::vintf::parse(text, s);
         if (!ret) {
@@ -364,7 +1073,50 @@ struct XmlNodeConverter : public XmlConverter<Object> {
         return ret;
     }
 protected:
-    mutable std::string mLastError;
+    mutable details::PerThreadString mLastError;
+};
+
+// Builds up to limit child elements with conv in streaming mode. Stops at the
+// first element that cannot be converted and keeps the error.
+template <typename T>
+class XmlStreamChildren : public XmlStreamSlot {
+   public:
+    explicit XmlStreamChildren(const XmlNodeConverter<T> &conv, size_t limit = SIZE_MAX)
+        : XmlStreamSlot(conv.elementName(), &conv), mConverter(conv), mLimit(limit) {}
+    bool read(XmlPullParser *parser) override {
+        if (mFailed || mValues.size() >= mLimit) {
+            return parser->skipElement();
+        }
+        XmlStreamElement child(parser);
+        T value;
+        if (!mConverter.streamObject(&value, &child)) {
+            if (parser->failed()) {
+                return false;
+            }
+            mFailed = true;
+            mError = mConverter.lastError();
+            return true;
+        }
+        mValues.push_back(std::move(value));
+        return true;
+    }
+    inline std::vector<T> &values() { return mValues; }
+    inline bool failed() const { return mFailed; }
+    inline const std::string &error() const { return mError; }
+
+   private:
+    const XmlNodeConverter<T> &mConverter;
+    size_t mLimit;
+    std::vector<T> mValues;
+    bool mFailed = false;
+    std::string mError;
+};
+
+// Builds the first child element with conv in streaming mode.
+template <typename T>
+class XmlStreamChild : public XmlStreamChildren<T> {
+   public:
+    explicit XmlStreamChild(const XmlNodeConverter<T> &conv) : XmlStreamChildren<T>(conv, 1) {}
 };
 
 template<typename Object>
@@ -372,12 +1124,15 @@ struct XmlTextConverter : public XmlNodeConverter<Object> {
     XmlTextConverter(const std::string &elementName)
         : mElementName(elementName) {}
 
-    virtual void mutateNode(const Object &object, NodeType *root, DocType *d) const override {
-        appendText(root, ::android::vintf::to_string(object), d);
+    virtual void mutateNode(const Object &object, XmlWriter *root) const override {
+        this->appendText(root, ::android::vintf::to_string(object));
     }
     virtual bool buildObject(Object *object, NodeType *root) const override {
         return this->parseText(root, object);
     }
+    virtual bool streamObject(Object *object, XmlStreamElement *root) const override {
+        return root->readContent({}) && this->parseText(root, object);
+    }
     virtual std::string elementName() const { return mElementName; };
 private:
     std::string mElementName;
@@ -393,13 +1148,20 @@ const XmlTextConverter<KernelConfigKey> kernelConfigKeyConverter{"key"};
 
 struct TransportArchConverter : public XmlNodeConverter<TransportArch> {
     std::string elementName() const override { return "transport"; }
-    void mutateNode(const TransportArch &object, NodeType *root, DocType *d) const override {
+    void mutateNode(const TransportArch &object, XmlWriter *root) const override {
         if (object.arch != Arch::ARCH_EMPTY) {
             appendAttr(root, "arch", object.arch);
         }
-        appendText(root, ::android::vintf::to_string(object.transport), d);
+        appendText(root, ::android::vintf::to_string(object.transport));
     }
     bool buildObject(TransportArch *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(TransportArch *object, XmlStreamElement *root) const override {
+        return root->readContent({}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(TransportArch *object, Node *root) const {
         if (!parseOptionalAttr(root, "arch", Arch::ARCH_EMPTY, &object->arch) ||
             !parseText(root, &object->transport)) {
             return false;
@@ -418,11 +1180,18 @@ const TransportArchConverter transportArchConverter{};
 
 struct KernelConfigTypedValueConverter : public XmlNodeConverter<KernelConfigTypedValue> {
     std::string elementName() const override { return "value"; }
-    void mutateNode(const KernelConfigTypedValue &object, NodeType *root, DocType *d) const override {
+    void mutateNode(const KernelConfigTypedValue &object, XmlWriter *root) const override {
         appendAttr(root, "type", object.mType);
-        appendText(root, ::android::vintf::to_string(object), d);
+        appendText(root, ::android::vintf::to_string(object));
     }
     bool buildObject(KernelConfigTypedValue *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(KernelConfigTypedValue *object, XmlStreamElement *root) const override {
+        return root->readContent({}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(KernelConfigTypedValue *object, Node *root) const {
         std::string stringValue;
         if (!parseAttr(root, "type", &object->mType) ||
             !parseText(root, &stringValue)) {
@@ -440,11 +1209,20 @@ const KernelConfigTypedValueConverter kernelConfigTypedValueConverter{};
 
 struct KernelConfigConverter : public XmlNodeConverter<KernelConfig> {
     std::string elementName() const override { return "config"; }
-    void mutateNode(const KernelConfig &object, NodeType *root, DocType *d) const override {
-        appendChild(root, kernelConfigKeyConverter(object.first, d));
-        appendChild(root, kernelConfigTypedValueConverter(object.second, d));
+    void mutateNode(const KernelConfig &object, XmlWriter *root) const override {
+        appendChild(root, kernelConfigKeyConverter, object.first);
+        appendChild(root, kernelConfigTypedValueConverter, object.second);
     }
     bool buildObject(KernelConfig *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(KernelConfig *object, XmlStreamElement *root) const override {
+        XmlStreamChild<KernelConfigKey> key{kernelConfigKeyConverter};
+        XmlStreamChild<KernelConfigTypedValue> value{kernelConfigTypedValueConverter};
+        return root->readContent({&key, &value}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(KernelConfig *object, Node *root) const {
         if (   !parseChild(root, kernelConfigKeyConverter, &object->first)
             || !parseChild(root, kernelConfigTypedValueConverter, &object->second)) {
             return false;
@@ -457,11 +1235,20 @@ const KernelConfigConverter kernelConfigConverter{};
 
 struct HalInterfaceConverter : public XmlNodeConverter<HalInterface> {
     std::string elementName() const override { return "interface"; }
-    void mutateNode(const HalInterface &intf, NodeType *root, DocType *d) const override {
-        appendTextElement(root, "name", intf.name, d);
-        appendTextElements(root, "instance", intf.instances, d);
+    void mutateNode(const HalInterface &intf, XmlWriter *root) const override {
+        appendTextElement(root, "name", intf.name);
+        appendTextElements(root, "instance", intf.instances);
     }
     bool buildObject(HalInterface *intf, NodeType *root) const override {
+        return buildObjectFrom(intf, root);
+    }
+    bool streamObject(HalInterface *intf, XmlStreamElement *root) const override {
+        XmlStreamTexts name{"name"};
+        XmlStreamTexts instances{"instance"};
+        return root->readContent({&name, &instances}) && buildObjectFrom(intf, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(HalInterface *intf, Node *root) const {
         std::vector<std::string> instances;
         if (!parseTextElement(root, "name", &intf->name) ||
             !parseTextElements(root, "instance", &instances)) {
@@ -481,14 +1268,25 @@ const HalInterfaceConverter halInterfaceConverter{};
 
 struct MatrixHalConverter : public XmlNodeConverter<MatrixHal> {
     std::string elementName() const override { return "hal"; }
-    void mutateNode(const MatrixHal &hal, NodeType *root, DocType *d) const override {
+    void mutateNode(const MatrixHal &hal, XmlWriter *root) const override {
         appendAttr(root, "format", hal.format);
         appendAttr(root, "optional", hal.optional);
-        appendTextElement(root, "name", hal.name, d);
-        appendChildren(root, versionRangeConverter, hal.versionRanges, d);
-        appendChildren(root, halInterfaceConverter, iterateValues(hal.interfaces), d);
+        appendTextElement(root, "name", hal.name);
+        appendChildren(root, versionRangeConverter, hal.versionRanges);
+        appendChildren(root, halInterfaceConverter, iterateValues(hal.interfaces));
     }
     bool buildObject(MatrixHal *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(MatrixHal *object, XmlStreamElement *root) const override {
+        XmlStreamTexts name{"name"};
+        XmlStreamChildren<VersionRange> versionRanges{versionRangeConverter};
+        XmlStreamChildren<HalInterface> interfaces{halInterfaceConverter};
+        return root->readContent({&name, &versionRanges, &interfaces}) &&
+               buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(MatrixHal *object, Node *root) const {
         std::vector<HalInterface> interfaces;
         if (!parseOptionalAttr(root, "format", HalFormat::HIDL, &object->format) ||
             !parseOptionalAttr(root, "optional", false /* defaultValue */, &object->optional) ||
@@ -498,7 +1296,7 @@ struct MatrixHalConverter : public XmlNodeConverter<MatrixHal> {
             return false;
         }
         for (auto&& interface : interfaces) {
-            std::string name{interface.name};
+            InternedString name = interface.name;
             auto res = object->interfaces.emplace(std::move(name), std::move(interface));
             if (!res.second) {
                 this->mLastError = "Duplicated interface entry \"" + res.first->first +
@@ -551,11 +1349,18 @@ const MatrixHalConverter matrixHalConverter{};
 
 struct MatrixKernelConditionsConverter : public XmlNodeConverter<std::vector<KernelConfig>> {
     std::string elementName() const override { return "conditions"; }
-    void mutateNode(const std::vector<KernelConfig>& conds, NodeType* root,
-                    DocType* d) const override {
-        appendChildren(root, kernelConfigConverter, conds, d);
+    void mutateNode(const std::vector<KernelConfig> &conds, XmlWriter *root) const override {
+        appendChildren(root, kernelConfigConverter, conds);
     }
     bool buildObject(std::vector<KernelConfig>* object, NodeType* root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(std::vector<KernelConfig>* object, XmlStreamElement* root) const override {
+        XmlStreamChildren<KernelConfig> configs{kernelConfigConverter};
+        return root->readContent({&configs}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(std::vector<KernelConfig>* object, Node* root) const {
         return parseChildren(root, kernelConfigConverter, object);
     }
 };
@@ -564,14 +1369,23 @@ const MatrixKernelConditionsConverter matrixKernelConditionsConverter{};
 
 struct MatrixKernelConverter : public XmlNodeConverter<MatrixKernel> {
     std::string elementName() const override { return "kernel"; }
-    void mutateNode(const MatrixKernel &kernel, NodeType *root, DocType *d) const override {
+    void mutateNode(const MatrixKernel &kernel, XmlWriter *root) const override {
         appendAttr(root, "version", kernel.mMinLts);
         if (!kernel.mConditions.empty()) {
-            appendChild(root, matrixKernelConditionsConverter(kernel.mConditions, d));
+            appendChild(root, matrixKernelConditionsConverter, kernel.mConditions);
         }
-        appendChildren(root, kernelConfigConverter, kernel.mConfigs, d);
+        appendChildren(root, kernelConfigConverter, kernel.mConfigs);
     }
     bool buildObject(MatrixKernel *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(MatrixKernel *object, XmlStreamElement *root) const override {
+        XmlStreamChild<std::vector<KernelConfig>> conditions{matrixKernelConditionsConverter};
+        XmlStreamChildren<KernelConfig> configs{kernelConfigConverter};
+        return root->readContent({&conditions, &configs}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(MatrixKernel *object, Node *root) const {
         if (!parseAttr(root, "version", &object->mMinLts) ||
             !parseOptionalChild(root, matrixKernelConditionsConverter, {}, &object->mConditions) ||
             !parseChildren(root, kernelConfigConverter, &object->mConfigs)) {
@@ -585,14 +1399,26 @@ const MatrixKernelConverter matrixKernelConverter{};
 
 struct ManifestHalConverter : public XmlNodeConverter<ManifestHal> {
     std::string elementName() const override { return "hal"; }
-    void mutateNode(const ManifestHal &hal, NodeType *root, DocType *d) const override {
+    void mutateNode(const ManifestHal &hal, XmlWriter *root) const override {
         appendAttr(root, "format", hal.format);
-        appendTextElement(root, "name", hal.name, d);
-        appendChild(root, transportArchConverter(hal.transportArch, d));
-        appendChildren(root, versionConverter, hal.versions, d);
-        appendChildren(root, halInterfaceConverter, iterateValues(hal.interfaces), d);
+        appendTextElement(root, "name", hal.name);
+        appendChild(root, transportArchConverter, hal.transportArch);
+        appendChildren(root, versionConverter, hal.versions);
+        appendChildren(root, halInterfaceConverter, iterateValues(hal.interfaces));
     }
     bool buildObject(ManifestHal *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(ManifestHal *object, XmlStreamElement *root) const override {
+        XmlStreamTexts name{"name"};
+        XmlStreamChild<TransportArch> transportArch{transportArchConverter};
+        XmlStreamChildren<Version> versions{versionConverter};
+        XmlStreamChildren<HalInterface> interfaces{halInterfaceConverter};
+        return root->readContent({&name, &transportArch, &versions, &interfaces}) &&
+               buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(ManifestHal *object, Node *root) const {
         std::vector<HalInterface> interfaces;
         if (!parseOptionalAttr(root, "format", HalFormat::HIDL, &object->format) ||
             !parseTextElement(root, "name", &object->name) ||
@@ -677,11 +1503,21 @@ const XmlTextConverter<VersionRange> sepolicyVersionConverter{"sepolicy-version"
 
 struct SepolicyConverter : public XmlNodeConverter<Sepolicy> {
     std::string elementName() const override { return "sepolicy"; }
-    void mutateNode(const Sepolicy &object, NodeType *root, DocType *d) const override {
-        appendChild(root, kernelSepolicyVersionConverter(object.kernelSepolicyVersion(), d));
-        appendChildren(root, sepolicyVersionConverter, object.sepolicyVersions(), d);
+    void mutateNode(const Sepolicy &object, XmlWriter *root) const override {
+        appendChild(root, kernelSepolicyVersionConverter, object.kernelSepolicyVersion());
+        appendChildren(root, sepolicyVersionConverter, object.sepolicyVersions());
     }
     bool buildObject(Sepolicy *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(Sepolicy *object, XmlStreamElement *root) const override {
+        XmlStreamChild<KernelSepolicyVersion> kernelSepolicyVersion{kernelSepolicyVersionConverter};
+        XmlStreamChildren<VersionRange> sepolicyVersions{sepolicyVersionConverter};
+        return root->readContent({&kernelSepolicyVersion, &sepolicyVersions}) &&
+               buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(Sepolicy *object, Node *root) const {
         if (!parseChild(root, kernelSepolicyVersionConverter, &object->mKernelSepolicyVersion) ||
             !parseChildren(root, sepolicyVersionConverter, &object->mSepolicyVersionRanges)) {
             return false;
@@ -696,11 +1532,20 @@ const XmlTextConverter<std::string> vndkLibraryConverter{"library"};
 
 struct VndkConverter : public XmlNodeConverter<Vndk> {
     std::string elementName() const override { return "vndk"; }
-    void mutateNode(const Vndk &object, NodeType *root, DocType *d) const override {
-        appendChild(root, vndkVersionRangeConverter(object.mVersionRange, d));
-        appendChildren(root, vndkLibraryConverter, object.mLibraries, d);
+    void mutateNode(const Vndk &object, XmlWriter *root) const override {
+        appendChild(root, vndkVersionRangeConverter, object.mVersionRange);
+        appendChildren(root, vndkLibraryConverter, object.mLibraries);
     }
     bool buildObject(Vndk *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(Vndk *object, XmlStreamElement *root) const override {
+        XmlStreamChild<VndkVersionRange> versionRange{vndkVersionRangeConverter};
+        XmlStreamChildren<std::string> libraries{vndkLibraryConverter};
+        return root->readContent({&versionRange, &libraries}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(Vndk *object, Node *root) const {
         if (!parseChild(root, vndkVersionRangeConverter, &object->mVersionRange) ||
             !parseChildren(root, vndkLibraryConverter, &object->mLibraries)) {
             return false;
@@ -713,10 +1558,18 @@ const VndkConverter vndkConverter{};
 
 struct HalManifestSepolicyConverter : public XmlNodeConverter<Version> {
     std::string elementName() const override { return "sepolicy"; }
-    void mutateNode(const Version &m, NodeType *root, DocType *d) const override {
-        appendChild(root, versionConverter(m, d));
+    void mutateNode(const Version &m, XmlWriter *root) const override {
+        appendChild(root, versionConverter, m);
     }
     bool buildObject(Version *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(Version *object, XmlStreamElement *root) const override {
+        XmlStreamChild<Version> version{versionConverter};
+        return root->readContent({&version}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(Version *object, Node *root) const {
         return parseChild(root, versionConverter, object);
     }
 };
@@ -724,14 +1577,24 @@ const HalManifestSepolicyConverter halManifestSepolicyConverter{};
 
 struct ManifestXmlFileConverter : public XmlNodeConverter<ManifestXmlFile> {
     std::string elementName() const override { return "xmlfile"; }
-    void mutateNode(const ManifestXmlFile& f, NodeType* root, DocType* d) const override {
-        appendTextElement(root, "name", f.name(), d);
-        appendChild(root, versionConverter(f.version(), d));
+    void mutateNode(const ManifestXmlFile &f, XmlWriter *root) const override {
+        appendTextElement(root, "name", f.name());
+        appendChild(root, versionConverter, f.version());
         if (!f.overriddenPath().empty()) {
-            appendTextElement(root, "path", f.overriddenPath(), d);
+            appendTextElement(root, "path", f.overriddenPath());
         }
     }
     bool buildObject(ManifestXmlFile* object, NodeType* root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(ManifestXmlFile* object, XmlStreamElement* root) const override {
+        XmlStreamTexts name{"name"};
+        XmlStreamChild<Version> version{versionConverter};
+        XmlStreamTexts path{"path"};
+        return root->readContent({&name, &version, &path}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(ManifestXmlFile* object, Node* root) const {
         if (!parseTextElement(root, "name", &object->mName) ||
             !parseChild(root, versionConverter, &object->mVersion) ||
             !parseOptionalTextElement(root, "path", {}, &object->mOverriddenPath)) {
@@ -744,20 +1607,32 @@ const ManifestXmlFileConverter manifestXmlFileConverter{};
 
 struct HalManifestConverter : public XmlNodeConverter<HalManifest> {
     std::string elementName() const override { return "manifest"; }
-    void mutateNode(const HalManifest &m, NodeType *root, DocType *d) const override {
+    void mutateNode(const HalManifest &m, XmlWriter *root) const override {
         appendAttr(root, "version", HalManifest::kVersion);
         appendAttr(root, "type", m.mType);
 
-        appendChildren(root, manifestHalConverter, m.getHals(), d);
+        appendChildren(root, manifestHalConverter, m.getHals());
         if (m.mType == SchemaType::DEVICE) {
-            appendChild(root, halManifestSepolicyConverter(m.device.mSepolicyVersion, d));
+            appendChild(root, halManifestSepolicyConverter, m.device.mSepolicyVersion);
         } else if (m.mType == SchemaType::FRAMEWORK) {
-            appendChildren(root, vndkConverter, m.framework.mVndks, d);
+            appendChildren(root, vndkConverter, m.framework.mVndks);
         }
 
-        appendChildren(root, manifestXmlFileConverter, m.getXmlFiles(), d);
+        appendChildren(root, manifestXmlFileConverter, m.getXmlFiles());
     }
     bool buildObject(HalManifest *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(HalManifest *object, XmlStreamElement *root) const override {
+        XmlStreamChildren<ManifestHal> hals{manifestHalConverter};
+        XmlStreamChild<Version> sepolicy{halManifestSepolicyConverter};
+        XmlStreamChildren<Vndk> vndks{vndkConverter};
+        XmlStreamChildren<ManifestXmlFile> xmlFiles{manifestXmlFileConverter};
+        return root->readContent({&hals, &sepolicy, &vndks, &xmlFiles}) &&
+               buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(HalManifest *object, Node *root) const {
         Version version;
         std::vector<ManifestHal> hals;
         if (!parseAttr(root, "version", &version) ||
@@ -789,12 +1664,10 @@ struct HalManifestConverter : public XmlNodeConverter<HalManifest> {
                 }
             }
         }
-        for (auto &&hal : hals) {
-            std::string description{hal.name};
-            if (!object->add(std::move(hal))) {
-                this->mLastError = "Duplicated manifest.hal entry " + description;
-                return false;
-            }
+        size_t rejected;
+        if (!object->addAll(std::move(hals), &rejected)) {
+            this->mLastError = "Duplicated manifest.hal entry " + hals[rejected].name.str();
+            return false;
         }
 
         std::vector<ManifestXmlFile> xmlFiles;
@@ -819,10 +1692,18 @@ const HalManifestConverter halManifestConverter{};
 const XmlTextConverter<Version> avbVersionConverter{"vbmeta-version"};
 struct AvbConverter : public XmlNodeConverter<Version> {
     std::string elementName() const override { return "avb"; }
-    void mutateNode(const Version &m, NodeType *root, DocType *d) const override {
-        appendChild(root, avbVersionConverter(m, d));
+    void mutateNode(const Version &m, XmlWriter *root) const override {
+        appendChild(root, avbVersionConverter, m);
     }
     bool buildObject(Version *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(Version *object, XmlStreamElement *root) const override {
+        XmlStreamChild<Version> version{avbVersionConverter};
+        return root->readContent({&version}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(Version *object, Node *root) const {
         return parseChild(root, avbVersionConverter, object);
     }
 };
@@ -830,16 +1711,26 @@ const AvbConverter avbConverter{};
 
 struct MatrixXmlFileConverter : public XmlNodeConverter<MatrixXmlFile> {
     std::string elementName() const override { return "xmlfile"; }
-    void mutateNode(const MatrixXmlFile& f, NodeType* root, DocType* d) const override {
-        appendTextElement(root, "name", f.name(), d);
+    void mutateNode(const MatrixXmlFile &f, XmlWriter *root) const override {
         appendAttr(root, "format", f.format());
         appendAttr(root, "optional", f.optional());
-        appendChild(root, versionRangeConverter(f.versionRange(), d));
+        appendTextElement(root, "name", f.name());
+        appendChild(root, versionRangeConverter, f.versionRange());
         if (!f.overriddenPath().empty()) {
-            appendTextElement(root, "path", f.overriddenPath(), d);
+            appendTextElement(root, "path", f.overriddenPath());
         }
     }
     bool buildObject(MatrixXmlFile* object, NodeType* root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(MatrixXmlFile* object, XmlStreamElement* root) const override {
+        XmlStreamTexts name{"name"};
+        XmlStreamChild<VersionRange> versionRange{versionRangeConverter};
+        XmlStreamTexts path{"path"};
+        return root->readContent({&name, &versionRange, &path}) && buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(MatrixXmlFile* object, Node* root) const {
         if (!parseTextElement(root, "name", &object->mName) ||
             !parseAttr(root, "format", &object->mFormat) ||
             !parseOptionalAttr(root, "optional", false, &object->mOptional) ||
@@ -854,21 +1745,35 @@ const MatrixXmlFileConverter matrixXmlFileConverter{};
 
 struct CompatibilityMatrixConverter : public XmlNodeConverter<CompatibilityMatrix> {
     std::string elementName() const override { return "compatibility-matrix"; }
-    void mutateNode(const CompatibilityMatrix &m, NodeType *root, DocType *d) const override {
+    void mutateNode(const CompatibilityMatrix &m, XmlWriter *root) const override {
         appendAttr(root, "version", CompatibilityMatrix::kVersion);
         appendAttr(root, "type", m.mType);
-        appendChildren(root, matrixHalConverter, iterateValues(m.mHals), d);
+        appendChildren(root, matrixHalConverter, iterateValues(m.mHals));
         if (m.mType == SchemaType::FRAMEWORK) {
-            appendChildren(root, matrixKernelConverter, m.framework.mKernels, d);
-            appendChild(root, sepolicyConverter(m.framework.mSepolicy, d));
-            appendChild(root, avbConverter(m.framework.mAvbMetaVersion, d));
+            appendChildren(root, matrixKernelConverter, m.framework.mKernels);
+            appendChild(root, sepolicyConverter, m.framework.mSepolicy);
+            appendChild(root, avbConverter, m.framework.mAvbMetaVersion);
         } else if (m.mType == SchemaType::DEVICE) {
-            appendChild(root, vndkConverter(m.device.mVndk, d));
+            appendChild(root, vndkConverter, m.device.mVndk);
         }
 
-        appendChildren(root, matrixXmlFileConverter, m.getXmlFiles(), d);
+        appendChildren(root, matrixXmlFileConverter, m.getXmlFiles());
     }
     bool buildObject(CompatibilityMatrix *object, NodeType *root) const override {
+        return buildObjectFrom(object, root);
+    }
+    bool streamObject(CompatibilityMatrix *object, XmlStreamElement *root) const override {
+        XmlStreamChildren<MatrixHal> hals{matrixHalConverter};
+        XmlStreamChildren<MatrixKernel> kernels{matrixKernelConverter};
+        XmlStreamChild<Sepolicy> sepolicy{sepolicyConverter};
+        XmlStreamChild<Version> avb{avbConverter};
+        XmlStreamChild<Vndk> vndk{vndkConverter};
+        XmlStreamChildren<MatrixXmlFile> xmlFiles{matrixXmlFileConverter};
+        return root->readContent({&hals, &kernels, &sepolicy, &avb, &vndk, &xmlFiles}) &&
+               buildObjectFrom(object, root);
+    }
+    template <typename Node>
+    bool buildObjectFrom(CompatibilityMatrix *object, Node *root) const {
         Version version;
         std::vector<MatrixHal> hals;
         if (!parseAttr(root, "version", &version) ||
@@ -912,11 +1817,9 @@ struct CompatibilityMatrixConverter : public XmlNodeConverter<CompatibilityMatri
             this->mLastError = "Unrecognized compatibility-matrix.version";
             return false;
         }
-        for (auto &&hal : hals) {
-            if (!object->add(std::move(hal))) {
-                this->mLastError = "Duplicated compatibility-matrix.hal entry";
-                return false;
-            }
+        if (!object->addAll(std::move(hals))) {
+            this->mLastError = "Duplicated compatibility-matrix.hal entry";
+            return false;
         }
 
         std::vector<MatrixXmlFile> xmlFiles;
@@ -942,10 +1845,38 @@ struct CompatibilityMatrixConverter : public XmlNodeConverter<CompatibilityMatri
 
 const CompatibilityMatrixConverter compatibilityMatrixConverter{};
 
+// Reads XML documents in a single pass with deserializeStreaming() instead of
+// building a DOM. Everything else is the same as Converter.
+template <typename Object, typename Converter>
+struct XmlStreamingConverter : public Converter {
+    using Converter::deserialize;
+    bool deserialize(Object *o, const std::string &xml) const override {
+        return this->deserializeStreaming(o, xml);
+    }
+};
+
+const XmlStreamingConverter<HalManifest, HalManifestConverter> halManifestStreamingConverter{};
+const XmlStreamingConverter<CompatibilityMatrix, CompatibilityMatrixConverter>
+        compatibilityMatrixStreamingConverter{};
+
 // Publicly available as in parse_xml.h
-const XmlConverter<HalManifest> &gHalManifestConverter = halManifestConverter;
+const XmlConverter<HalManifest> &gHalManifestConverter = halManifestStreamingConverter;
 const XmlConverter<CompatibilityMatrix> &gCompatibilityMatrixConverter
-        = compatibilityMatrixConverter;
+        = compatibilityMatrixStreamingConverter;
+
+std::string getRootElementName(const std::string &xml) {
+    XmlPullParser parser(xml);
+    for (;;) {
+        switch (parser.next()) {
+            case XmlPullParser::START_ELEMENT:
+                return parser.name();
+            case XmlPullParser::OTHER:
+                continue;
+            default:
+                return "";
+        }
+    }
+}
 
 // For testing in LibVintfTest
 const XmlConverter<Version> &gVersionConverter = versionConverter;
@@ -953,6 +1884,9 @@ const XmlConverter<KernelConfigTypedValue> &gKernelConfigTypedValueConverter
         = kernelConfigTypedValueConverter;
 const XmlConverter<MatrixHal> &gMatrixHalConverter = matrixHalConverter;
 const XmlConverter<ManifestHal> &gManifestHalConverter = manifestHalConverter;
+const XmlConverter<HalManifest> &gHalManifestDomConverter = halManifestConverter;
+const XmlConverter<CompatibilityMatrix> &gCompatibilityMatrixDomConverter
+        = compatibilityMatrixConverter;
 
 } // namespace vintf
 } // namespace android
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LibVintfBenchmark"
+
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/test_utils.h>
+#include <benchmark/benchmark.h>
+
+#include <vintf/CompatibilityMatrix.h>
+#include <vintf/HalManifest.h>
+#include <vintf/KernelConfigParser.h>
+#include <vintf/ParsedXmlCache.h>
+#include <vintf/RuntimeInfo.h>
+#include <vintf/parse_xml.h>
+
+namespace android {
+namespace vintf {
+
+// Generates synthetic inputs. The device manifest, the framework compatibility
+// matrix and the runtime info that are generated with the same sizes are
+// compatible with each other, so the compatibility checks run to completion.
+struct LibVintfBenchmark {
+    static std::string halName(size_t i) { return "android.hardware.bench" + std::to_string(i); }
+
+    static std::string configName(size_t i) { return "CONFIG_BENCH_" + std::to_string(i); }
+
+    // The value of configName(i) in the kernel config and in the matrix.
+    static std::string configValue(size_t i) {
+        switch (i % 3) {
+            case 0: return "y";
+            case 1: return std::to_string(i);
+            default: return "\"value" + std::to_string(i) + "\"";
+        }
+    }
+
+    static std::string configType(size_t i) {
+        switch (i % 3) {
+            case 0: return "tristate";
+            case 1: return "int";
+            default: return "string";
+        }
+    }
+
+    static std::string deviceManifestXml(size_t numHals) {
+        std::string xml = "<manifest version=\"1.0\" type=\"device\">\n";
+        for (size_t i = 0; i < numHals; ++i) {
+            xml += "    <hal format=\"hidl\">\n"
+                   "        <name>" + halName(i) + "</name>\n"
+                   "        <transport>hwbinder</transport>\n"
+                   "        <version>1." + std::to_string(i % 3) + "</version>\n"
+                   "        <interface>\n"
+                   "            <name>IBench</name>\n"
+                   "            <instance>default</instance>\n"
+                   "            <instance>legacy/0</instance>\n"
+                   "        </interface>\n"
+                   "    </hal>\n";
+        }
+        xml += "    <sepolicy>\n"
+               "        <version>25.0</version>\n"
+               "    </sepolicy>\n"
+               "</manifest>\n";
+        return xml;
+    }
+
+    // With numFragments > 1, the kernel section is repeated for several LTS versions,
+    // and for each version the configs are repeated in conditional fragments, like
+    // the arch-specific fragments of a real matrix.
+    static std::string frameworkMatrixXml(size_t numHals, size_t numConfigs,
+                                          size_t numFragments = 1) {
+        std::string xml = "<compatibility-matrix version=\"1.0\" type=\"framework\">\n";
+        for (size_t i = 0; i < numHals; ++i) {
+            xml += "    <hal format=\"hidl\" optional=\"false\">\n"
+                   "        <name>" + halName(i) + "</name>\n"
+                   "        <version>1.0-2</version>\n"
+                   "        <interface>\n"
+                   "            <name>IBench</name>\n"
+                   "            <instance>default</instance>\n"
+                   "        </interface>\n"
+                   "    </hal>\n";
+        }
+        std::string configs;
+        for (size_t i = 0; i < numConfigs; ++i) {
+            std::string value = configValue(i);
+            if (configType(i) == "string") {
+                value = value.substr(1, value.size() - 2);
+            }
+            configs += "        <config>\n"
+                       "            <key>" + configName(i) + "</key>\n"
+                       "            <value type=\"" + configType(i) + "\">" + value +
+                       "</value>\n"
+                       "        </config>\n";
+        }
+        std::vector<std::string> versions{"3.18.22"};
+        if (numFragments > 1) {
+            versions = {"3.18.22", "4.4.0", "4.9.0"};
+        }
+        for (const std::string& version : versions) {
+            xml += "    <kernel version=\"" + version + "\">\n" + configs + "    </kernel>\n";
+            for (size_t i = 1; i < numFragments; ++i) {
+                xml += "    <kernel version=\"" + version + "\">\n"
+                       "        <conditions>\n"
+                       "            <config>\n"
+                       "                <key>" + configName(0) + "</key>\n"
+                       "                <value type=\"tristate\">y</value>\n"
+                       "            </config>\n"
+                       "        </conditions>\n" +
+                       configs + "    </kernel>\n";
+            }
+        }
+        xml += "    <sepolicy>\n"
+               "        <kernel-sepolicy-version>30</kernel-sepolicy-version>\n"
+               "        <sepolicy-version>25.0</sepolicy-version>\n"
+               "    </sepolicy>\n"
+               "    <avb>\n"
+               "        <vbmeta-version>2.1</vbmeta-version>\n"
+               "    </avb>\n"
+               "</compatibility-matrix>\n";
+        return xml;
+    }
+
+    // Contents of /proc/config.gz, after decompression.
+    static std::string kernelConfigText(size_t numConfigs) {
+        std::string text = "#\n# Automatically generated file; DO NOT EDIT.\n#\n";
+        for (size_t i = 0; i < numConfigs; ++i) {
+            text += configName(i) + "=" + configValue(i) + "\n";
+            if (i % 10 == 0) {
+                text += "# CONFIG_BENCH_UNSET_" + std::to_string(i) + " is not set\n";
+            }
+        }
+        return text;
+    }
+
+    static void buildKernelRequirementTable(CompatibilityMatrix* matrix) {
+        matrix->buildKernelRequirementTable();
+    }
+
+    static RuntimeInfo runtimeInfo(size_t numConfigs) {
+        RuntimeInfo info;
+        info.mOsName = "Linux";
+        info.mOsRelease = "3.18.31-g936f9a479d0f";
+        info.mKernelVersion = {3, 18, 31};
+        info.mKernelSepolicyVersion = 30;
+        info.mBootVbmetaAvbVersion = {2, 1};
+        info.mBootAvbVersion = {2, 1};
+        std::string text = kernelConfigText(numConfigs);
+        KernelConfigParser parser;
+        parser.process(text.data(), text.size());
+        parser.finish();
+        info.mKernelConfigs = std::move(parser.configs());
+        return info;
+    }
+};
+
+namespace {
+
+using B = LibVintfBenchmark;
+
+void BM_HalManifestDeserialize(benchmark::State& state) {
+    std::string xml = B::deviceManifestXml(state.range(0));
+    for (auto _ : state) {
+        HalManifest manifest;
+        if (!gHalManifestConverter(&manifest, xml)) {
+            state.SkipWithError(gHalManifestConverter.lastError().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(manifest);
+    }
+    state.SetBytesProcessed(state.iterations() * xml.size());
+}
+BENCHMARK(BM_HalManifestDeserialize)->Arg(50)->Arg(500);
+
+void BM_HalManifestSerialize(benchmark::State& state) {
+    HalManifest manifest;
+    if (!gHalManifestConverter(&manifest, B::deviceManifestXml(state.range(0)))) {
+        state.SkipWithError(gHalManifestConverter.lastError().c_str());
+        return;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(gHalManifestConverter(manifest));
+    }
+}
+BENCHMARK(BM_HalManifestSerialize)->Arg(50)->Arg(500);
+
+void BM_CompatibilityMatrixDeserialize(benchmark::State& state) {
+    std::string xml = B::frameworkMatrixXml(state.range(0), state.range(1));
+    for (auto _ : state) {
+        CompatibilityMatrix matrix;
+        if (!gCompatibilityMatrixConverter(&matrix, xml)) {
+            state.SkipWithError(gCompatibilityMatrixConverter.lastError().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(matrix);
+    }
+    state.SetBytesProcessed(state.iterations() * xml.size());
+}
+BENCHMARK(BM_CompatibilityMatrixDeserialize)->Args({50, 300})->Args({500, 5000});
+
+void BM_CompatibilityMatrixSerialize(benchmark::State& state) {
+    CompatibilityMatrix matrix;
+    if (!gCompatibilityMatrixConverter(&matrix,
+                                       B::frameworkMatrixXml(state.range(0), state.range(1)))) {
+        state.SkipWithError(gCompatibilityMatrixConverter.lastError().c_str());
+        return;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(gCompatibilityMatrixConverter(matrix));
+    }
+}
+BENCHMARK(BM_CompatibilityMatrixSerialize)->Args({50, 300})->Args({500, 5000});
+
+// Arg 1: cache capacity; 0 parses the XML every time.
+void BM_ParsedXmlCacheParse(benchmark::State& state) {
+    std::string xml = B::frameworkMatrixXml(state.range(0), 300);
+    ParsedXmlCache cache(state.range(1));
+    std::shared_ptr<const HalManifest> manifest;
+    std::shared_ptr<const CompatibilityMatrix> matrix;
+    for (auto _ : state) {
+        if (!cache.parse(xml, &manifest, &matrix)) {
+            state.SkipWithError(gCompatibilityMatrixConverter.lastError().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(matrix);
+    }
+}
+BENCHMARK(BM_ParsedXmlCacheParse)->Args({500, 0})->Args({500, 16});
+
+void BM_HalManifestCheckCompatibility(benchmark::State& state) {
+    HalManifest manifest;
+    CompatibilityMatrix matrix;
+    if (!gHalManifestConverter(&manifest, B::deviceManifestXml(state.range(0))) ||
+        !gCompatibilityMatrixConverter(&matrix, B::frameworkMatrixXml(state.range(0), 0))) {
+        state.SkipWithError("Cannot generate inputs");
+        return;
+    }
+    std::string error;
+    for (auto _ : state) {
+        if (!manifest.checkCompatibility(matrix, &error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+    }
+}
+BENCHMARK(BM_HalManifestCheckCompatibility)->Arg(50)->Arg(500);
+
+void BM_RuntimeInfoCheckCompatibility(benchmark::State& state) {
+    RuntimeInfo info = B::runtimeInfo(state.range(0));
+    CompatibilityMatrix matrix;
+    if (!gCompatibilityMatrixConverter(&matrix, B::frameworkMatrixXml(0, state.range(0)))) {
+        state.SkipWithError(gCompatibilityMatrixConverter.lastError().c_str());
+        return;
+    }
+    std::string error;
+    for (auto _ : state) {
+        if (!info.checkCompatibility(matrix, &error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+    }
+}
+BENCHMARK(BM_RuntimeInfoCheckCompatibility)->Arg(300)->Arg(5000);
+
+// Arg 1: number of fragments per kernel version. Arg 2: whether to build the
+// kernel requirement table, like CompatibilityMatrix::fetchAllInformation does.
+void BM_RuntimeInfoCheckKernelFragments(benchmark::State& state) {
+    RuntimeInfo info = B::runtimeInfo(state.range(0));
+    CompatibilityMatrix matrix;
+    if (!gCompatibilityMatrixConverter(
+            &matrix, B::frameworkMatrixXml(0, state.range(0), state.range(1)))) {
+        state.SkipWithError(gCompatibilityMatrixConverter.lastError().c_str());
+        return;
+    }
+    if (state.range(2)) {
+        B::buildKernelRequirementTable(&matrix);
+    }
+    std::string error;
+    for (auto _ : state) {
+        if (!info.checkCompatibility(matrix, &error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+    }
+}
+BENCHMARK(BM_RuntimeInfoCheckKernelFragments)
+        ->Args({300, 4, 0})
+        ->Args({300, 4, 1})
+        ->Args({5000, 4, 0})
+        ->Args({5000, 4, 1});
+
+void BM_KernelConfigParserProcess(benchmark::State& state) {
+    std::string text = B::kernelConfigText(state.range(0));
+    // Arg 1: whether to parse like assemble_vintf, which processes comments and allows spaces.
+    bool relaxed = state.range(1);
+    for (auto _ : state) {
+        KernelConfigParser parser(relaxed /* processComments */, relaxed /* relaxedFormat */);
+        if (parser.process(text.data(), text.size()) != OK || parser.finish() != OK) {
+            state.SkipWithError("Cannot parse kernel configs");
+            break;
+        }
+        benchmark::DoNotOptimize(parser.configs());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_KernelConfigParserProcess)
+        ->Args({300, 0})
+        ->Args({300, 1})
+        ->Args({5000, 0})
+        ->Args({5000, 1});
+
+// Writes kernelConfigText(numConfigs) to a gzip-compressed file, like /proc/config.gz.
+class KernelConfigGzFile {
+   public:
+    explicit KernelConfigGzFile(size_t numConfigs) {
+        std::string text = B::kernelConfigText(numConfigs);
+        gzFile f = gzdopen(dup(mFile.fd), "wb");
+        mOk = f != nullptr && gzwrite(f, text.data(), text.size()) == static_cast<int>(text.size());
+        mOk = f != nullptr && gzclose(f) == Z_OK && mOk;
+    }
+    bool ok() const { return mOk; }
+    const char* path() const { return mFile.path; }
+
+   private:
+    TemporaryFile mFile;
+    bool mOk;
+};
+
+// The way /proc/config.gz used to be read: gzread() into a page-sized buffer.
+void BM_KernelConfigGzread(benchmark::State& state) {
+    KernelConfigGzFile file(state.range(0));
+    if (!file.ok()) {
+        state.SkipWithError("Cannot write config.gz");
+        return;
+    }
+    std::vector<char> buf(sysconf(_SC_PAGESIZE));
+    for (auto _ : state) {
+        KernelConfigParser parser;
+        gzFile f = gzopen(file.path(), "rb");
+        int len;
+        while ((len = gzread(f, buf.data(), buf.size())) > 0) {
+            parser.process(buf.data(), len);
+        }
+        parser.finish();
+        gzclose(f);
+        benchmark::DoNotOptimize(parser.configs());
+    }
+}
+BENCHMARK(BM_KernelConfigGzread)->Arg(5500);
+
+// Arg 1: chunk size.
+void BM_KernelConfigProcessFile(benchmark::State& state) {
+    KernelConfigGzFile file(state.range(0));
+    if (!file.ok()) {
+        state.SkipWithError("Cannot write config.gz");
+        return;
+    }
+    for (auto _ : state) {
+        KernelConfigParser parser;
+        if (parser.processFile(file.path(), state.range(1)) != OK) {
+            state.SkipWithError(parser.error()->str().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(parser.configs());
+    }
+}
+BENCHMARK(BM_KernelConfigProcessFile)
+        ->Args({5500, 4096})
+        ->Args({5500, 16384})
+        ->Args({5500, 65536})
+        ->Args({5500, 262144});
+
+}  // namespace
+
+}  // namespace vintf
+}  // namespace android
+
+int main(int argc, char** argv) {
+    // Report results as JSON unless another format is requested, so that they can be
+    // collected and compared over time.
+    std::vector<char*> args(argv, argv + argc);
+    char jsonFormat[] = "--benchmark_format=json";
+    bool hasFormat = false;
+    for (int i = 1; i < argc; ++i) {
+        hasFormat |= strncmp(argv[i], "--benchmark_format=", strlen("--benchmark_format=")) == 0;
+    }
+    if (!hasFormat) {
+        args.insert(args.begin() + 1, jsonFormat);
+    }
+    int newArgc = args.size();
+    benchmark::Initialize(&newArgc, args.data());
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
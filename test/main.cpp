@@ -16,17 +16,26 @@
 
 #define LOG_TAG "LibHidlTest"
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
 #include <algorithm>
 #include <functional>
+#include <sstream>
+#include <thread>
 
 #include <vintf/CompatibilityMatrix.h>
 #include <vintf/KernelConfigParser.h>
 #include <vintf/VintfObject.h>
+#include <vintf/parse_binary.h>
 #include <vintf/parse_string.h>
 #include <vintf/parse_xml.h>
 
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
 namespace android {
@@ -38,6 +47,8 @@ extern const XmlConverter<MatrixHal> &gMatrixHalConverter;
 extern const XmlConverter<KernelConfigTypedValue> &gKernelConfigTypedValueConverter;
 extern const XmlConverter<HalManifest> &gHalManifestConverter;
 extern const XmlConverter<CompatibilityMatrix> &gCompatibilityMatrixConverter;
+extern const XmlConverter<HalManifest> &gHalManifestDomConverter;
+extern const XmlConverter<CompatibilityMatrix> &gCompatibilityMatrixDomConverter;
 
 static bool Contains(const std::string& str, const std::string& sub) {
     return str.find(sub) != std::string::npos;
@@ -60,6 +71,13 @@ public:
     bool add(HalManifest &vm, ManifestHal &&hal) {
         return vm.add(std::move(hal));
     }
+    bool addAll(HalManifest& vm, std::vector<ManifestHal>&& hals, size_t* rejected) {
+        return vm.addAll(std::move(hals), rejected);
+    }
+    bool buildKernelRequirementTable(CompatibilityMatrix& cm) {
+        cm.buildKernelRequirementTable();
+        return cm.mKernelRequirements.get() != nullptr;
+    }
     void addXmlFile(CompatibilityMatrix& cm, std::string name, VersionRange range) {
         MatrixXmlFile f;
         f.mName = name;
@@ -76,7 +94,7 @@ public:
     }
     void set(CompatibilityMatrix &cm, VndkVersionRange &&range, std::set<std::string> &&libs) {
         cm.device.mVndk.mVersionRange = range;
-        cm.device.mVndk.mLibraries = libs;
+        cm.device.mVndk.mLibraries.insert(libs.begin(), libs.end());
     }
     void setAvb(RuntimeInfo &ki, Version vbmeta, Version boot) {
         ki.mBootVbmetaAvbVersion = vbmeta;
@@ -94,19 +112,21 @@ public:
     MatrixHal *getAnyHal(CompatibilityMatrix &cm, const std::string &name) {
         return cm.getAnyHal(name);
     }
-    ConstMultiMapValueIterable<std::string, ManifestHal> getHals(HalManifest &vm) {
+    HalManifest::ConstHalIterable getHals(HalManifest &vm) {
         return vm.getHals();
     }
+    void buildTransportTable(HalManifest& vm) { vm.buildTransportTable(); }
+    bool hasTransportTable(const HalManifest& vm) { return vm.mTransportTable.get() != nullptr; }
     bool isValid(const ManifestHal &mh) {
         return mh.isValid();
     }
     std::vector<MatrixKernel>& getKernels(CompatibilityMatrix& cm) { return cm.framework.mKernels; }
 
-    std::map<std::string, HalInterface> testHalInterfaces() {
+    decltype(ManifestHal::interfaces) testHalInterfaces() {
         HalInterface intf;
         intf.name = "IFoo";
         intf.instances.insert("default");
-        std::map<std::string, HalInterface> map;
+        decltype(ManifestHal::interfaces) map;
         map[intf.name] = intf;
         return map;
     }
@@ -394,6 +414,60 @@ TEST_F(LibVintfTest, HalManifestGetTransport) {
               vm.getTransport("android.hidl.manager", {1, 0}, "IServiceManager", "default"));
 }
 
+TEST_F(LibVintfTest, HalManifestGetTransportTable) {
+    HalManifest vm = testDeviceManifest();
+    std::vector<std::tuple<std::string, Version, std::string, std::string>> queries{
+        {"android.hardware.camera", {2, 0}, "ICamera", "default"},
+        {"android.hardware.camera", {2, 0}, "ICamera", "legacy/0"},
+        {"android.hardware.camera", {2, 0}, "IBetterCamera", "camera"},
+        {"android.hardware.camera", {2, 1}, "ICamera", "default"},
+        {"android.hardware.camera", {1, 0}, "ICamera", "default"},
+        {"android.hardware.camera", {2, 0}, "ICamera", "notexist"},
+        {"android.hardware.camera", {2, 0}, "INotExist", "default"},
+        {"android.hardware.nfc", {1, 0}, "INfc", "default"},
+        {"android.hardware.nfc", {2, 0}, "INfc", "default"},
+        {"android.hardware.notexist", {1, 0}, "INfc", "default"},
+    };
+    std::vector<Transport> expected;
+    for (const auto& q : queries) {
+        expected.push_back(
+            vm.getTransport(std::get<0>(q), std::get<1>(q), std::get<2>(q), std::get<3>(q)));
+    }
+
+    buildTransportTable(vm);
+    EXPECT_TRUE(hasTransportTable(vm));
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto& q = queries[i];
+        EXPECT_EQ(expected[i],
+                  vm.getTransport(std::get<0>(q), std::get<1>(q), std::get<2>(q), std::get<3>(q)))
+            << std::get<0>(q) << "@" << std::get<1>(q) << "::" << std::get<2>(q) << "/"
+            << std::get<3>(q);
+    }
+
+    HalManifest moved = std::move(vm);
+    EXPECT_TRUE(hasTransportTable(moved));
+    EXPECT_EQ(Transport::HWBINDER,
+              moved.getTransport("android.hardware.camera", {2, 0}, "ICamera", "default"));
+
+    HalManifest copy = moved;
+    EXPECT_FALSE(hasTransportTable(copy));
+    EXPECT_EQ(Transport::HWBINDER,
+              copy.getTransport("android.hardware.camera", {2, 0}, "ICamera", "default"));
+
+    EXPECT_TRUE(add(moved, ManifestHal{
+        .format = HalFormat::HIDL,
+        .name = "android.hardware.foo",
+        .versions = {Version(1, 0)},
+        .transportArch = {Transport::HWBINDER, Arch::ARCH_EMPTY},
+        .interfaces = {
+            {"IFoo", {"IFoo", {"default"}}}
+        }
+    }));
+    EXPECT_FALSE(hasTransportTable(moved));
+    EXPECT_EQ(Transport::HWBINDER,
+              moved.getTransport("android.hardware.foo", {1, 0}, "IFoo", "default"));
+}
+
 TEST_F(LibVintfTest, HalManifestInstances) {
     HalManifest vm = testDeviceManifest();
     EXPECT_EQ(vm.getInstances("android.hardware.camera", "ICamera"),
@@ -426,8 +500,8 @@ TEST_F(LibVintfTest, VersionConverter) {
     EXPECT_EQ(v, v2);
 }
 
-static bool insert(std::map<std::string, HalInterface>* map, HalInterface&& intf) {
-    std::string name{intf.name};
+static bool insert(decltype(MatrixHal::interfaces)* map, HalInterface&& intf) {
+    InternedString name = intf.name;
     return map->emplace(std::move(name), std::move(intf)).second;
 }
 
@@ -640,6 +714,203 @@ TEST_F(LibVintfTest, DeviceCompatibilityMatrixCoverter) {
     EXPECT_EQ(cm, cm2);
 }
 
+TEST_F(LibVintfTest, BinaryImageHalManifest) {
+    for (const HalManifest& vm : {testDeviceManifestWithXmlFile(), testFrameworkManfiest()}) {
+        std::string xml = gHalManifestConverter(vm);
+        std::string image = gHalManifestBinaryConverter.serialize(vm, xml);
+        HalManifest vm2;
+        EXPECT_TRUE(gHalManifestBinaryConverter.deserialize(&vm2, image.data(), image.size(), xml))
+            << gHalManifestBinaryConverter.lastError();
+        EXPECT_EQ(vm, vm2);
+    }
+}
+
+TEST_F(LibVintfTest, BinaryImageCompatibilityMatrix) {
+    CompatibilityMatrix cm;
+    EXPECT_TRUE(add(cm, MatrixHal{HalFormat::NATIVE, "android.hardware.camera",
+            {{VersionRange(1,2,3), VersionRange(4,5,6)}},
+            false /* optional */, testHalInterfaces()}));
+    EXPECT_TRUE(add(cm, MatrixKernel{KernelVersion(3, 18, 22),
+            {KernelConfig{"CONFIG_FOO", Tristate::YES}, KernelConfig{"CONFIG_BAR", "stringvalue"}}}));
+    EXPECT_TRUE(add(cm, MatrixKernel{KernelVersion(4, 4, 1),
+            {KernelConfig{"CONFIG_BAZ", 20}, KernelConfig{"CONFIG_BAR", KernelConfigRangeValue{3, 5} }}}));
+    set(cm, Sepolicy(30, {{25, 0}, {26, 0, 3}}));
+    setAvb(cm, Version{2, 1});
+    addXmlFile(cm, "media_profile", {1, 0});
+    std::string xml = gCompatibilityMatrixConverter(cm);
+    std::string image = gCompatibilityMatrixBinaryConverter.serialize(cm, xml);
+
+    CompatibilityMatrix cm2;
+    EXPECT_TRUE(gCompatibilityMatrixBinaryConverter.deserialize(&cm2, image.data(), image.size(),
+                                                                xml))
+        << gCompatibilityMatrixBinaryConverter.lastError();
+    EXPECT_EQ(cm, cm2);
+
+    CompatibilityMatrix cm3;
+    EXPECT_FALSE(gCompatibilityMatrixBinaryConverter.deserialize(&cm3, image.data(), image.size(),
+                                                                 xml + "\n"))
+        << "Should not load an image compiled from a file of another size";
+    std::string edited = xml;
+    edited.replace(edited.find("CONFIG_FOO"), strlen("CONFIG_FOO"), "CONFIG_BAZ");
+    ASSERT_EQ(xml.size(), edited.size());
+    EXPECT_FALSE(gCompatibilityMatrixBinaryConverter.deserialize(&cm3, image.data(), image.size(),
+                                                                 edited))
+        << "Should not load an image compiled from a file of the same size but another content";
+    EXPECT_FALSE(gCompatibilityMatrixBinaryConverter.deserialize(&cm3, image.data(),
+                                                                 image.size() - 1, xml))
+        << "Should not load a truncated image";
+    HalManifest vm;
+    EXPECT_FALSE(gHalManifestBinaryConverter.deserialize(&vm, image.data(), image.size(), xml))
+        << "Should not load a compatibility matrix image as a manifest";
+}
+
+TEST_F(LibVintfTest, StreamingHalManifestConverter) {
+    std::vector<std::string> xmls = {
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<!-- comment -->\n"
+        "<manifest version=\"1.0\" type=\"device\">\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.camera</name>\n"
+        "        <!-- comment -->\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <version>2.0</version>\n"
+        "        <interface>\n"
+        "            <name>ICamera</name>\n"
+        "            <instance>legacy/0</instance>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "        <unknown><name>ignored</name></unknown>\n"
+        "    </hal>\n"
+        "    <hal format='native'><name>&quot;native&amp;&quot;</name><version>1.0</version></hal>\n"
+        "    <sepolicy>\n"
+        "        <version>25.5</version>\n"
+        "    </sepolicy>\n"
+        "</manifest>\n"
+        "<!-- trailing comment -->\n",
+        // Conversion errors; the first one in buildObject order is reported.
+        "<manifest version=\"1.0\" type=\"device\">\n"
+        "    <hal><name>a</name><transport>hwbinder</transport><version>x</version></hal>\n"
+        "    <hal><name>b</name><version>1.0</version></hal>\n"
+        "</manifest>\n",
+        "<manifest version=\"1.0\" type=\"device\">\n"
+        "    <hal><name>a</name><transport>hwbinder</transport><version>1.0</version></hal>\n"
+        "    <hal><name>a</name><transport>hwbinder</transport><version>1.0</version></hal>\n"
+        "</manifest>\n",
+        "<manifest version=\"1.0\" type=\"device\">\n"
+        "    <sepolicy><version>bad</version></sepolicy>\n"
+        "    <hal><transport>hwbinder</transport></hal>\n"
+        "</manifest>\n",
+        "<manifest version=\"2.0\" type=\"framework\"><vndk/></manifest>",
+        "<manifest version=\"1.0\"></manifest>",
+        "<compatibility-matrix version=\"1.0\" type=\"device\"/>",
+        // Malformed XML.
+        "<manifest version=\"1.0\" type=\"device\"><hal></manifest>",
+        "<manifest version=\"1.0\" type=\"device\" type=\"device\"/>",
+        "<manifest version=\"1.0\" type=\"device\"><!-- </manifest>",
+        "",
+    };
+    for (const auto& xml : xmls) {
+        HalManifest domManifest;
+        HalManifest streamingManifest;
+        bool domResult = gHalManifestDomConverter(&domManifest, xml);
+        EXPECT_EQ(domResult, gHalManifestConverter(&streamingManifest, xml)) << xml;
+        if (domResult) {
+            EXPECT_EQ(domManifest, streamingManifest) << xml;
+        } else {
+            EXPECT_EQ(gHalManifestDomConverter.lastError(), gHalManifestConverter.lastError())
+                << xml;
+        }
+    }
+}
+
+TEST_F(LibVintfTest, StreamingCompatibilityMatrixConverter) {
+    std::vector<std::string> xmls = {
+        "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.camera</name>\n"
+        "        <version>2.0-5</version>\n"
+        "        <version>3.4-16</version>\n"
+        "        <interface>\n"
+        "            <name>ICamera</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <kernel version=\"3.18.22\">\n"
+        "        <config>\n"
+        "            <key>CONFIG_FOO</key>\n"
+        "            <value type=\"tristate\">y</value>\n"
+        "        </config>\n"
+        "    </kernel>\n"
+        "    <kernel version=\"3.18.22\">\n"
+        "        <conditions>\n"
+        "            <config><key>CONFIG_ARM</key><value type=\"tristate\">y</value></config>\n"
+        "        </conditions>\n"
+        "        <config><key>CONFIG_BAR</key><value type=\"string\">&lt;a b&gt;</value></config>\n"
+        "    </kernel>\n"
+        "    <sepolicy>\n"
+        "        <kernel-sepolicy-version>30</kernel-sepolicy-version>\n"
+        "        <sepolicy-version>25.0</sepolicy-version>\n"
+        "        <sepolicy-version>26.0-3</sepolicy-version>\n"
+        "    </sepolicy>\n"
+        "    <avb>\n"
+        "        <vbmeta-version>2.1</vbmeta-version>\n"
+        "    </avb>\n"
+        "    <xmlfile format=\"dtd\" optional=\"true\">\n"
+        "        <name>media_profile</name>\n"
+        "        <version>1.0</version>\n"
+        "        <path>/system/etc/media_profile.dtd</path>\n"
+        "    </xmlfile>\n"
+        "</compatibility-matrix>\n",
+        "<compatibility-matrix version=\"1.0\" type=\"device\">\n"
+        "    <vndk>\n"
+        "        <version>25.0.1-5</version>\n"
+        "        <library>libjpeg.so</library>\n"
+        "        <library>libbase.so</library>\n"
+        "    </vndk>\n"
+        "</compatibility-matrix>\n",
+        // Conversion errors.
+        "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+        "    <kernel version=\"3.18.22\">\n"
+        "        <conditions><config><key>CONFIG_ARM</key></config></conditions>\n"
+        "    </kernel>\n"
+        "</compatibility-matrix>\n",
+        "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+        "    <kernel version=\"3.18.22\">\n"
+        "        <conditions>\n"
+        "            <config><key>CONFIG_ARM</key><value type=\"tristate\">y</value></config>\n"
+        "        </conditions>\n"
+        "    </kernel>\n"
+        "</compatibility-matrix>\n",
+        "<compatibility-matrix version=\"1.0\" type=\"device\">\n"
+        "    <vndk><version>25.0.1-5</version><library>a</library><library>a</library></vndk>\n"
+        "</compatibility-matrix>\n",
+        "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+        "    <xmlfile format=\"dtd\"><name>a</name><version>1.0</version></xmlfile>\n"
+        "    <hal><name>a</name><version>1.0</version></hal>\n"
+        "    <hal><name>a</name><version>1.0</version></hal>\n"
+        "</compatibility-matrix>\n",
+        "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+        "    <sepolicy><sepolicy-version>25.0</sepolicy-version></sepolicy>\n"
+        "</compatibility-matrix>\n",
+        // Malformed XML.
+        "<compatibility-matrix version=\"1.0\" type=\"framework\"><avb></compatibility-matrix>",
+        "<compatibility-matrix version=\"1.0\" type=\"framework\"",
+    };
+    for (const auto& xml : xmls) {
+        CompatibilityMatrix domMatrix;
+        CompatibilityMatrix streamingMatrix;
+        bool domResult = gCompatibilityMatrixDomConverter(&domMatrix, xml);
+        EXPECT_EQ(domResult, gCompatibilityMatrixConverter(&streamingMatrix, xml)) << xml;
+        if (domResult) {
+            EXPECT_EQ(domMatrix, streamingMatrix) << xml;
+        } else {
+            EXPECT_EQ(gCompatibilityMatrixDomConverter.lastError(),
+                      gCompatibilityMatrixConverter.lastError())
+                << xml;
+        }
+    }
+}
+
 TEST_F(LibVintfTest, IsValid) {
     EXPECT_TRUE(isValid(ManifestHal()));
 
@@ -1052,6 +1323,77 @@ TEST_F(LibVintfTest, HalCompat) {
     }
 }
 
+TEST_F(LibVintfTest, HalCompatInterfaceSubset) {
+    std::string manifestXml =
+            "<manifest version=\"1.0\" type=\"device\">\n"
+            "    <hal format=\"hidl\">\n"
+            "        <name>android.hardware.foo</name>\n"
+            "        <transport>hwbinder</transport>\n"
+            "        <version>1.1</version>\n"
+            "        <version>2.0</version>\n"
+            "        <interface>\n"
+            "            <name>IBar</name>\n"
+            "            <instance>default</instance>\n"
+            "        </interface>\n"
+            "        <interface>\n"
+            "            <name>IBaz</name>\n"
+            "            <instance>default</instance>\n"
+            "            <instance>legacy</instance>\n"
+            "            <instance>specific</instance>\n"
+            "        </interface>\n"
+            "        <interface>\n"
+            "            <name>IFoo</name>\n"
+            "            <instance>default</instance>\n"
+            "        </interface>\n"
+            "    </hal>\n"
+            "</manifest>\n";
+    HalManifest manifest;
+    ASSERT_TRUE(gHalManifestConverter(&manifest, manifestXml))
+            << gHalManifestConverter.lastError();
+
+    auto isCompatible = [&](const std::string& version, const std::string& interfaces) {
+        std::string matrixXml =
+                "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+                "    <hal format=\"hidl\" optional=\"false\">\n"
+                "        <name>android.hardware.foo</name>\n"
+                "        <version>" + version + "</version>\n" + interfaces +
+                "    </hal>\n"
+                "</compatibility-matrix>\n";
+        CompatibilityMatrix matrix;
+        EXPECT_TRUE(gCompatibilityMatrixConverter(&matrix, matrixXml))
+                << gCompatibilityMatrixConverter.lastError();
+        return manifest.checkIncompatibility(matrix).empty();
+    };
+    std::string iBaz =
+            "        <interface>\n"
+            "            <name>IBaz</name>\n"
+            "            <instance>legacy</instance>\n"
+            "            <instance>specific</instance>\n"
+            "        </interface>\n";
+    std::string iFoo =
+            "        <interface>\n"
+            "            <name>IFoo</name>\n"
+            "            <instance>default</instance>\n"
+            "        </interface>\n";
+    std::string iQux =
+            "        <interface>\n"
+            "            <name>IQux</name>\n"
+            "            <instance>default</instance>\n"
+            "        </interface>\n";
+    EXPECT_TRUE(isCompatible("1.0", ""));
+    EXPECT_TRUE(isCompatible("1.0", iBaz + iFoo));
+    EXPECT_TRUE(isCompatible("2.0", iFoo));
+    EXPECT_FALSE(isCompatible("1.2", iFoo));
+    EXPECT_FALSE(isCompatible("3.0", iFoo));
+    EXPECT_FALSE(isCompatible("1.0", iBaz + iQux));
+    EXPECT_FALSE(isCompatible("1.0", iFoo + iQux));
+    EXPECT_FALSE(isCompatible("1.0",
+                              "        <interface>\n"
+                              "            <name>IBaz</name>\n"
+                              "            <instance>missing</instance>\n"
+                              "        </interface>\n"));
+}
+
 TEST_F(LibVintfTest, Compat) {
     std::string manifestXml =
         "<manifest version=\"1.0\" type=\"device\">\n"
@@ -1254,6 +1596,29 @@ TEST_F(LibVintfTest, CompatibilityMatrixConverterXmlFile2) {
         gCompatibilityMatrixConverter.lastError());
 }
 
+TEST_F(LibVintfTest, HalManifestConverterSinks) {
+    std::string expectXml =
+        "<manifest version=\"1.0\" type=\"framework\">\n"
+        "    <xmlfile>\n"
+        "        <name>media_profile</name>\n"
+        "        <version>1.0</version>\n"
+        "        <path>/etc/a&amp;b&lt;c&gt;\"d'.xml</path>\n"
+        "    </xmlfile>\n"
+        "</manifest>\n";
+    HalManifest vm;
+    EXPECT_TRUE(gHalManifestConverter(&vm, expectXml));
+    EXPECT_EQ("/etc/a&b<c>\"d'.xml", vm.getXmlFilePath("media_profile", {1, 0}));
+    EXPECT_EQ(expectXml, gHalManifestConverter(vm));
+
+    std::string buffer = "<!-- -->\n";
+    gHalManifestConverter.serialize(vm, &buffer);
+    EXPECT_EQ("<!-- -->\n" + expectXml, buffer);
+
+    std::ostringstream stream;
+    gHalManifestConverter.serialize(vm, stream);
+    EXPECT_EQ(expectXml, stream.str());
+}
+
 TEST_F(LibVintfTest, ManifestXmlFilePathDevice) {
     std::string manifestXml =
         "<manifest version=\"1.0\" type=\"device\">"
@@ -1453,6 +1818,343 @@ TEST_F(LibVintfTest, KernelConfigParserSpace) {
     EXPECT_EQ(configs.find("CONFIG_NOT_SET")->second, "n");
 }
 
+TEST_F(LibVintfTest, GetRootElementName) {
+    EXPECT_EQ("manifest", getRootElementName("<manifest version=\"1.0\" type=\"device\">"));
+    EXPECT_EQ("compatibility-matrix",
+              getRootElementName("<?xml version=\"1.0\"?>\n<!-- comment -->\n"
+                                 "<compatibility-matrix version=\"1.0\"/>"));
+    EXPECT_EQ("manifest", getRootElementName("\xEF\xBB\xBF  <manifest>"));
+    EXPECT_EQ("", getRootElementName(""));
+    EXPECT_EQ("", getRootElementName("manifest"));
+    EXPECT_EQ("", getRootElementName("<!-- <manifest>"));
+}
+
+TEST_F(LibVintfTest, KernelConfigTable) {
+    std::map<std::string, std::string> map{
+        {"CONFIG_B", "y"}, {"CONFIG_A", "y"}, {"CONFIG_AB", "\"str\""}, {"CONFIG_C", ""}};
+    KernelConfigTable table(map);
+    EXPECT_EQ(map.size(), table.size());
+    using Entries = std::vector<std::pair<std::string, std::string>>;
+    EXPECT_EQ(Entries(map.begin(), map.end()), Entries(table.begin(), table.end()))
+        << "Should iterate in the same order as std::map";
+    for (const auto& pair : map) {
+        auto it = table.find(pair.first);
+        ASSERT_NE(table.end(), it) << pair.first;
+        EXPECT_EQ(pair.first, it->first);
+        EXPECT_EQ(pair.second, it->second);
+        EXPECT_EQ(pair.second, table.at(pair.first));
+        ParsedKernelConfigValue value;
+        ASSERT_TRUE(table.lookup(pair.first.data(), pair.first.size(), &value));
+        EXPECT_EQ(pair.second, std::string(value.string, value.length));
+    }
+    for (const std::string key : {"", "CONFIG_", "CONFIG_AA", "CONFIG_D", "CONFIG_A "}) {
+        EXPECT_EQ(table.end(), table.find(key)) << key;
+        EXPECT_EQ(0u, table.count(key)) << key;
+    }
+    EXPECT_EQ(KernelConfigTable{}, KernelConfigTable(std::map<std::string, std::string>{}));
+
+    KernelConfigTable fromList{{"CONFIG_C", ""}, {"CONFIG_AB", "\"str\""}, {"CONFIG_A", "y"},
+                               {"CONFIG_B", "y"}, {"CONFIG_A", "n"}};
+    EXPECT_EQ(table, fromList) << "First value of a duplicated key should be kept";
+    EXPECT_NE(table, KernelConfigTable({{"CONFIG_A", "y"}}));
+}
+
+TEST_F(LibVintfTest, KernelConfigMatchParsedValue) {
+    std::vector<KernelConfigTypedValue> matrixValues{
+        KernelConfigTypedValue(Tristate::YES), KernelConfigTypedValue(Tristate::MODULE),
+        KernelConfigTypedValue(Tristate::NO), KernelConfigTypedValue(0),
+        KernelConfigTypedValue(16), KernelConfigTypedValue(KernelConfigRangeValue{1, 3}),
+        KernelConfigTypedValue(KernelConfigRangeValue{16, 16}),
+        KernelConfigTypedValue(""), KernelConfigTypedValue("str"),
+        KernelConfigTypedValue("y")};
+    std::vector<std::string> kernelValues{
+        "y", "m", "n", "0", "16", "0x10", "020", "1-3", "16-16", "0x10-0x10", "1-3-5",
+        "-1", "18446744073709551616", "\"\"", "\"str\"", "\"y\"", "str", "\"", "\"str", ""};
+    for (const std::string& kernelValue : kernelValues) {
+        KernelConfigTable table({{"CONFIG_A", kernelValue}});
+        ParsedKernelConfigValue parsed;
+        ASSERT_TRUE(table.lookup("CONFIG_A", strlen("CONFIG_A"), &parsed));
+        for (const KernelConfigTypedValue& matrixValue : matrixValues) {
+            EXPECT_EQ(matrixValue.matchValue(kernelValue), matrixValue.matchValue(parsed))
+                << to_string(matrixValue) << " against " << kernelValue;
+        }
+    }
+}
+
+TEST_F(LibVintfTest, SortedVectorMultiMap) {
+    SortedVectorMultiMap<std::string, int> map;
+    std::multimap<std::string, int> expected;
+    for (const auto& pair : std::vector<std::pair<std::string, int>>{
+             {"b", 1}, {"a", 2}, {"c", 3}, {"b", 4}, {"a", 5}, {"b", 6}}) {
+        map.emplace(std::string(pair.first), int(pair.second));
+        expected.emplace(pair.first, pair.second);
+    }
+    using Pairs = std::vector<std::pair<std::string, int>>;
+    EXPECT_EQ(Pairs(expected.begin(), expected.end()), Pairs(map.begin(), map.end()));
+
+    auto range = map.equal_range("b");
+    ASSERT_EQ(3, std::distance(range.first, range.second));
+    EXPECT_EQ(1, range.first->second);
+    EXPECT_EQ(6, (range.first + 2)->second);
+    EXPECT_EQ(2, map.find("a")->second);
+    EXPECT_EQ(map.end(), map.find("d"));
+    EXPECT_EQ(map.end(), map.find(""));
+
+    for (const auto& pair : std::vector<std::pair<std::string, int>>{
+             {"c", 7}, {"a", 8}, {"b", 9}, {"a", 10}}) {
+        map.append(std::string(pair.first), int(pair.second));
+        expected.emplace(pair.first, pair.second);
+    }
+    map.sort();
+    EXPECT_EQ(Pairs(expected.begin(), expected.end()), Pairs(map.begin(), map.end()))
+        << "append() and sort() should keep the order of emplace()";
+}
+
+TEST_F(LibVintfTest, HalManifestAddAll) {
+    auto makeHal = [](const std::string& name, Version version) {
+        return ManifestHal{.format = HalFormat::HIDL,
+                           .name = name,
+                           .versions = {version},
+                           .transportArch = {Transport::HWBINDER, Arch::ARCH_EMPTY}};
+    };
+    HalManifest vm = testDeviceManifest();
+    HalManifest unchanged = vm;
+    size_t rejected = 0;
+    std::vector<ManifestHal> hals{makeHal("android.hardware.foo", {1, 0}),
+                                  makeHal("android.hardware.camera", {2, 1})};
+    EXPECT_FALSE(addAll(vm, std::move(hals), &rejected)) << "Conflicts with an existing HAL";
+    EXPECT_EQ(1u, rejected);
+    EXPECT_EQ(unchanged, vm);
+
+    hals = {makeHal("android.hardware.foo", {1, 0}), makeHal("android.hardware.bar", {1, 0}),
+            makeHal("android.hardware.foo", {1, 1})};
+    EXPECT_FALSE(addAll(vm, std::move(hals), &rejected)) << "Conflicts with an earlier HAL";
+    EXPECT_EQ(2u, rejected);
+    EXPECT_EQ(unchanged, vm);
+
+    hals = {makeHal("android.hardware.foo", {2, 0}), makeHal("android.hardware.camera", {3, 0}),
+            makeHal("android.hardware.foo", {1, 0})};
+    EXPECT_TRUE(addAll(vm, std::move(hals), &rejected));
+    for (const ManifestHal& hal :
+         {makeHal("android.hardware.foo", {2, 0}), makeHal("android.hardware.camera", {3, 0}),
+          makeHal("android.hardware.foo", {1, 0})}) {
+        EXPECT_TRUE(add(unchanged, ManifestHal(hal)));
+    }
+    EXPECT_EQ(unchanged, vm) << "Should be the same as adding the HALs one by one";
+}
+
+TEST_F(LibVintfTest, InternedString) {
+    std::string camera = "android.hardware.camera";
+    InternedString a(camera);
+    InternedString b("android.hardware.camera");
+    InternedString c("android.hardware.audio");
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_EQ(a, b);
+    EXPECT_NE(a, c);
+    EXPECT_TRUE(c < a);
+    EXPECT_FALSE(a < b);
+    EXPECT_EQ(a, camera);
+    EXPECT_EQ("android.hardware.camera@1.0", a + "@1.0");
+    EXPECT_TRUE(InternedString().empty());
+    EXPECT_EQ(InternedString(), InternedString(""));
+
+    ManifestHal hal{.name = camera};
+    ManifestHal copy = hal;
+    EXPECT_EQ(&hal.name.str(), &copy.name.str());
+
+    // Strings are removed from the pool when their last copy is destroyed.
+    size_t poolSize = InternedString::poolSize();
+    {
+        InternedString d("android.hardware.interned.test");
+        InternedString e = d;
+        InternedString f = std::move(d);
+        EXPECT_TRUE(d.empty());
+        EXPECT_EQ(poolSize + 1, InternedString::poolSize());
+    }
+    EXPECT_EQ(poolSize, InternedString::poolSize());
+
+    // Threads interning the same and different strings all get the same entries.
+    std::vector<std::thread> threads;
+    std::vector<std::vector<InternedString>> interned(4);
+    for (auto& strings : interned) {
+        threads.emplace_back([&strings] {
+            for (int i = 0; i < 1000; ++i) {
+                strings.emplace_back("android.hardware.interned.test" + std::to_string(i % 100));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(poolSize + 100, InternedString::poolSize());
+    for (size_t i = 0; i < 1000; ++i) {
+        EXPECT_EQ(&interned[0][i].str(), &interned[3][i].str());
+    }
+    interned.clear();
+    EXPECT_EQ(poolSize, InternedString::poolSize());
+}
+
+TEST_F(LibVintfTest, Arena) {
+    HalManifest vm = testDeviceManifest();
+    std::string xml = gHalManifestConverter(vm);
+    std::string image = gHalManifestBinaryConverter.serialize(vm, xml);
+
+    HalManifest fromXml;
+    ASSERT_TRUE(gHalManifestConverter(&fromXml, xml)) << gHalManifestConverter.lastError();
+    HalManifest fromImage;
+    ASSERT_TRUE(gHalManifestBinaryConverter.deserialize(&fromImage, image.data(), image.size(), xml))
+        << gHalManifestBinaryConverter.lastError();
+
+    // Everything parsed from one document shares an arena.
+    for (HalManifest* parsed : {&fromXml, &fromImage}) {
+        std::shared_ptr<Arena> arena;
+        for (const ManifestHal& hal : getHals(*parsed)) {
+            for (const auto& pair : hal.interfaces) {
+                ASSERT_NE(nullptr, pair.second.instances.get_allocator().arena());
+                if (arena == nullptr) {
+                    arena = pair.second.instances.get_allocator().arena();
+                }
+                EXPECT_EQ(arena, pair.second.instances.get_allocator().arena());
+                EXPECT_EQ(arena, hal.interfaces.get_allocator().arena());
+            }
+        }
+        ASSERT_NE(nullptr, arena);
+        EXPECT_EQ(1u, arena->numBlocks());
+    }
+    const ManifestHal* built = getAnyHal(vm, "android.hardware.camera");
+    ASSERT_NE(nullptr, built);
+    EXPECT_EQ(nullptr, built->interfaces.begin()->second.instances.get_allocator().arena());
+
+    // Copies do not share the arena, and parsed objects can still be modified.
+    HalManifest copy = fromXml;
+    fromXml = HalManifest();
+    EXPECT_EQ(vm, copy);
+    EXPECT_EQ(nullptr, getAnyHal(copy, "android.hardware.camera")
+                           ->interfaces.begin()->second.instances.get_allocator().arena());
+
+    CompatibilityMatrix cm;
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&cm,
+        "<compatibility-matrix version=\"1.0\" type=\"framework\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "</compatibility-matrix>\n")) << gCompatibilityMatrixConverter.lastError();
+    MatrixHal* hal = getAnyHal(cm, "android.hardware.foo");
+    ASSERT_NE(nullptr, hal);
+    HalInterface& intf = hal->interfaces.begin()->second;
+    ASSERT_NE(nullptr, intf.instances.get_allocator().arena());
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(intf.instances.emplace("instance" + std::to_string(i)).second);
+    }
+    EXPECT_EQ(1u, intf.instances.erase("default"));
+    EXPECT_EQ(100u, intf.instances.size());
+    cm = CompatibilityMatrix();
+
+    // Arenas reject allocations once their scope ends.
+    std::shared_ptr<Arena> arena;
+    {
+        ArenaScope scope;
+        arena = ArenaScope::current();
+        EXPECT_EQ(scope.arena(), arena);
+        EXPECT_NE(nullptr, arena->allocate(16, 8));
+        {
+            ArenaScope inner;
+            EXPECT_EQ(inner.arena(), ArenaScope::current());
+        }
+        EXPECT_EQ(arena, ArenaScope::current());
+    }
+    EXPECT_EQ(nullptr, ArenaScope::current());
+    EXPECT_EQ(nullptr, arena->allocate(16, 8));
+}
+
+TEST_F(LibVintfTest, KernelConfigParserErrors) {
+    auto expectError = [](const std::string& data, bool relaxedFormat, const std::string& error) {
+        auto pair = processData(data, true /* processComments */, relaxedFormat);
+        EXPECT_NE(OK, pair.second) << data;
+        EXPECT_EQ(error, pair.first.error()->str()) << data;
+    };
+    expectError("CONFIG_A=1\nCONFIG_A=2\n", false, "Duplicated key in configs: CONFIG_A\n");
+    expectError(" CONFIG_A = 1\nCONFIG_A=2 #two\n", true, "Duplicated key in configs: CONFIG_A\n");
+    expectError("CONFIG_A=1\n# CONFIG_A is not set\n", false,
+                "Key CONFIG_A is set but commented as not set\n");
+    expectError("CONFIG_A=\n", true, "Unrecognized line in configs: CONFIG_A=\n");
+    expectError("CONFIG=1\n", true, "Unrecognized line in configs: CONFIG=1\n");
+    expectError("   \n", true, "Unrecognized line in configs:    \n");
+    expectError(" #comment\n", false, "Unrecognized line in configs:  #comment\n");
+    expectError("CONFIG_A\n", false, "Unrecognized line in configs: CONFIG_A\n");
+
+    auto pair = processData("CONFIG_A=   \nCONFIG_B= #comment\n", true, true);
+    ASSERT_EQ(OK, pair.second) << pair.first.error();
+    EXPECT_EQ(pair.first.configs().at("CONFIG_A"), "");
+    EXPECT_EQ(pair.first.configs().at("CONFIG_B"), "");
+}
+
+std::string gzipCompress(const std::string& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    EXPECT_EQ(Z_OK, deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                                 Z_DEFAULT_STRATEGY));
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = out.size();
+    EXPECT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+TEST_F(LibVintfTest, KernelConfigParserFile) {
+    std::string data;
+    for (size_t i = 0; i < 1000; ++i) {
+        data += "CONFIG_" + std::to_string(i) + "=y\n# CONFIG_UNSET_" + std::to_string(i) +
+                " is not set\n";
+    }
+    data += "CONFIG_LAST=\"no newline\"";
+    KernelConfigParser expected;
+    ASSERT_EQ(OK, expected.process(data.data(), data.size()));
+    ASSERT_EQ(OK, expected.finish());
+    std::string gzip = gzipCompress(data);
+
+    // Plain, compressed and concatenated compressed files, mapped or read from a pipe.
+    for (const std::string& contents : {data, gzip, gzipCompress(data.substr(0, 100)) +
+                                                        gzipCompress(data.substr(100))}) {
+        for (size_t chunkSize : {2u, 7u, 4096u}) {
+            TemporaryFile file;
+            ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+                      write(file.fd, contents.data(), contents.size()));
+            KernelConfigParser parser;
+            EXPECT_EQ(OK, parser.processFile(file.path, chunkSize)) << parser.error()->str();
+            EXPECT_EQ(expected.configs(), parser.configs());
+
+            int fds[2];
+            ASSERT_EQ(0, pipe(fds));
+            std::thread writer([&] {
+                EXPECT_EQ(static_cast<ssize_t>(contents.size()),
+                          write(fds[1], contents.data(), contents.size()));
+                close(fds[1]);
+            });
+            KernelConfigParser pipeParser;
+            EXPECT_EQ(OK, pipeParser.processFile(fds[0], chunkSize)) << pipeParser.error()->str();
+            writer.join();
+            close(fds[0]);
+            EXPECT_EQ(expected.configs(), pipeParser.configs());
+        }
+    }
+
+    TemporaryFile truncated;
+    ASSERT_EQ(100, write(truncated.fd, gzip.data(), 100));
+    KernelConfigParser parser;
+    EXPECT_EQ(BAD_VALUE, parser.processFile(truncated.path));
+    EXPECT_EQ(-ENOENT, parser.processFile("/nonexistent/config.gz"));
+}
+
 TEST_F(LibVintfTest, NetutilsWrapperMatrix) {
     std::string matrixXml;
     CompatibilityMatrix matrix;
@@ -1920,6 +2622,64 @@ TEST_F(LibVintfTest, KernelConfigConditionMatch) {
     EXPECT_FALSE(runtime.checkCompatibility(cm, &error)) << "all fragments should be used";
 }
 
+// The requirement table gives the same results and errors as going through the
+// fragments one by one.
+TEST_F(LibVintfTest, KernelRequirementTable) {
+    RuntimeInfo runtime = testRuntimeInfo();
+    auto kernel = [](const std::string& version, const std::string& conditions,
+                     const std::string& configs) {
+        std::string xml = "    <kernel version=\"" + version + "\">\n";
+        if (!conditions.empty()) {
+            xml += "        <conditions>" + conditions + "</conditions>\n";
+        }
+        return xml + configs + "    </kernel>\n";
+    };
+    auto config = [](const std::string& key, const std::string& type, const std::string& value) {
+        return "<config><key>" + key + "</key><value type=\"" + type + "\">" + value +
+               "</value></config>";
+    };
+    std::string is64Bit = config("CONFIG_64BIT", "tristate", "y");
+    std::string not64Bit = config("CONFIG_64BIT", "tristate", "n");
+    std::string rndBits = config("CONFIG_ARCH_MMAP_RND_BITS", "int", "24");
+    std::string badRndBits = config("CONFIG_ARCH_MMAP_RND_BITS", "int", "26");
+    std::string missing = config("CONFIG_MISSING", "tristate", "n");
+    std::string badMissing = config("CONFIG_MISSING", "tristate", "y");
+
+    const std::vector<std::pair<std::string, std::string>> kernelsAndErrors = {
+        {kernel("3.18.22", "", rndBits + missing) +
+             kernel("3.18.22", is64Bit, rndBits + is64Bit) +
+             kernel("3.18.22", not64Bit, badRndBits) + kernel("4.4.1", "", badRndBits),
+         ""},
+        {kernel("3.18.22", "", rndBits) + kernel("3.18.22", is64Bit + rndBits, badMissing),
+         "Missing config CONFIG_MISSING"},
+        {kernel("3.18.22", "", missing) + kernel("3.18.22", is64Bit, badRndBits),
+         "For config CONFIG_ARCH_MMAP_RND_BITS, value = 24 but required 26"},
+        {kernel("3.18.32", "", rndBits) + kernel("4.4.1", "", rndBits),
+         "Framework is incompatible with kernel version 3.18.31, compatible kernel versions "
+         "are 3.18.32 4.4.1"},
+    };
+    for (const auto& pair : kernelsAndErrors) {
+        std::string xml = "<compatibility-matrix version=\"1.0\" type=\"framework\">\n" +
+                          pair.first +
+                          "    <sepolicy>\n"
+                          "        <kernel-sepolicy-version>30</kernel-sepolicy-version>\n"
+                          "    </sepolicy>\n"
+                          "    <avb><vbmeta-version>2.1</vbmeta-version></avb>\n"
+                          "</compatibility-matrix>\n";
+        CompatibilityMatrix cm;
+        ASSERT_TRUE(gCompatibilityMatrixConverter(&cm, xml))
+            << gCompatibilityMatrixConverter.lastError();
+        std::string error;
+        EXPECT_EQ(pair.second.empty(), runtime.checkCompatibility(cm, &error)) << xml;
+        EXPECT_EQ(pair.second, error);
+
+        ASSERT_TRUE(buildKernelRequirementTable(cm));
+        std::string tableError;
+        EXPECT_EQ(pair.second.empty(), runtime.checkCompatibility(cm, &tableError)) << xml;
+        EXPECT_EQ(pair.second, tableError);
+    }
+}
+
 // Run KernelConfigParserInvalidTest on processComments = {true, false}
 class KernelConfigParserInvalidTest : public ::testing::TestWithParam<bool> {};
 
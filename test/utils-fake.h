@@ -32,9 +32,11 @@ class MockFileFetcher : public FileFetcher {
     MockFileFetcher() {
         // By default call through to the original.
         ON_CALL(*this, fetch(_, _)).WillByDefault(Invoke(&real_, &FileFetcher::fetch));
+        ON_CALL(*this, signature(_, _)).WillByDefault(Invoke(&real_, &FileFetcher::signature));
     }
 
     MOCK_METHOD2(fetch, status_t(const std::string& path, std::string& fetched));
+    MOCK_METHOD2(signature, status_t(const std::string& path, FileSignature* sig));
 
    private:
     FileFetcher real_;
@@ -15,14 +15,21 @@
  */
 
 #include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <android-base/test_utils.h>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <thread>
 
 #include "utils-fake.h"
+#include "vintf/CompatibilityChecker.h"
 #include "vintf/VintfObject.h"
+#include "vintf/parse_binary.h"
+#include "vintf/parse_xml.h"
 
 using namespace ::testing;
 using namespace ::android::vintf;
@@ -193,6 +200,8 @@ void setupMockFetcher(const std::string& vendorManifestXml, const std::string& s
             fetched = systemMatrixXml;
             return 0;
         }));
+    // Without signatures, files are considered changed every time.
+    ON_CALL(*fetcher, signature(_, _)).WillByDefault(Return(-1));
 }
 
 static MockPartitionMounter &mounter() {
@@ -394,6 +403,324 @@ TEST_F(VintfObjectCompatibleTest, TestFullOnlyOtaMount) {
     EXPECT_FALSE(mounter().vendorMounted());
 }
 
+// Tests that objects returned earlier stay valid when the cache is refreshed.
+TEST_F(VintfObjectCompatibleTest, TestObjectOutlivesSkipCache) {
+    auto manifest = VintfObject::GetSharedDeviceHalManifest(true /* skipCache */);
+    ASSERT_NE(manifest, nullptr);
+    EXPECT_EQ(manifest, VintfObject::GetSharedDeviceHalManifest());
+
+    auto refreshed = VintfObject::GetSharedDeviceHalManifest(true /* skipCache */);
+    ASSERT_NE(refreshed, nullptr);
+    EXPECT_NE(manifest, refreshed);
+    EXPECT_EQ(*manifest, *refreshed);
+    EXPECT_EQ(refreshed, VintfObject::GetSharedDeviceHalManifest());
+}
+
+// Tests that raw pointers returned earlier stay valid when the cache is refreshed.
+TEST_F(VintfObjectCompatibleTest, TestRawPointerOutlivesSkipCache) {
+    const HalManifest* manifest = VintfObject::GetDeviceHalManifest(true /* skipCache */);
+    ASSERT_NE(manifest, nullptr);
+    EXPECT_EQ(manifest, VintfObject::GetDeviceHalManifest());
+    EXPECT_EQ(manifest, VintfObject::GetSharedDeviceHalManifest().get());
+
+    const HalManifest* refreshed = VintfObject::GetDeviceHalManifest(true /* skipCache */);
+    ASSERT_NE(refreshed, nullptr);
+    EXPECT_NE(manifest, refreshed);
+    EXPECT_EQ(*manifest, *refreshed);
+
+    const RuntimeInfo* runtimeInfo = VintfObject::GetRuntimeInfo(true /* skipCache */);
+    ASSERT_NE(runtimeInfo, nullptr);
+    ASSERT_NE(VintfObject::GetRuntimeInfo(true /* skipCache */), nullptr);
+    EXPECT_EQ(KernelVersion(3, 18, 31), runtimeInfo->kernelVersion());
+}
+
+// Tests that GetRuntimeInfo only fetches the requested parts, and fetches the rest later.
+TEST_F(VintfObjectCompatibleTest, TestRuntimeInfoFetchFlags) {
+    auto partial =
+        VintfObject::GetSharedRuntimeInfo(true /* skipCache */, RuntimeInfo::CPU_VERSION);
+    ASSERT_NE(partial, nullptr);
+    EXPECT_EQ(RuntimeInfo::CPU_VERSION, partial->fetchedFlags());
+    EXPECT_EQ(KernelVersion(3, 18, 31), partial->kernelVersion());
+    EXPECT_TRUE(partial->kernelConfigs().empty());
+    EXPECT_EQ(partial, VintfObject::GetSharedRuntimeInfo(false, RuntimeInfo::CPU_VERSION));
+
+    auto full = VintfObject::GetSharedRuntimeInfo();
+    ASSERT_NE(full, nullptr);
+    EXPECT_NE(partial, full);
+    EXPECT_EQ(RuntimeInfo::ALL, full->fetchedFlags());
+    EXPECT_EQ(partial->kernelVersion(), full->kernelVersion());
+    EXPECT_FALSE(full->kernelConfigs().empty());
+    EXPECT_TRUE(partial->kernelConfigs().empty()) << "Returned objects should not be modified";
+    EXPECT_EQ(full, VintfObject::GetSharedRuntimeInfo(false, RuntimeInfo::CONFIG_GZ));
+}
+
+// Tests that CompatibilityChecker remembers results without mixing up packages.
+TEST_F(VintfObjectCompatibleTest, TestCompatibilityChecker) {
+    // Refresh the cached device info.
+    ASSERT_NE(nullptr, VintfObject::GetFrameworkHalManifest(true /* skipCache */));
+    ASSERT_NE(nullptr, VintfObject::GetDeviceHalManifest(true /* skipCache */));
+    ASSERT_NE(nullptr, VintfObject::GetFrameworkCompatibilityMatrix(true /* skipCache */));
+    ASSERT_NE(nullptr, VintfObject::GetDeviceCompatibilityMatrix(true /* skipCache */));
+
+    std::vector<std::vector<std::string>> packages{
+        {},
+        {systemMatrixXml1},
+        {systemMatrixXml2},
+        {systemMatrixXml2, vendorManifestXml2},
+        {systemMatrixXml1, systemManifestXml1},
+        {systemMatrixXml1, systemMatrixXml2},
+        {"<manifest"},
+    };
+    CompatibilityChecker checker;
+    // Evicts on almost every call.
+    CompatibilityChecker smallChecker(1);
+    for (size_t round = 0; round < 2; ++round) {
+        for (const auto& package : packages) {
+            std::string expectedError;
+            std::string error;
+            int32_t expected = VintfObject::CheckCompatibility(package, &expectedError);
+            EXPECT_EQ(expected, checker.checkCompatibility(package, &error));
+            EXPECT_EQ(expectedError, error);
+            error.clear();
+            EXPECT_EQ(expected, smallChecker.checkCompatibility(package, &error));
+            EXPECT_EQ(expectedError, error);
+        }
+    }
+    EXPECT_EQ(INCOMPATIBLE, checker.checkCompatibility({systemMatrixXml2}));
+
+    // Concurrent calls run their checks concurrently and give the same results.
+    std::vector<int32_t> expected;
+    for (const auto& package : packages) {
+        expected.push_back(VintfObject::CheckCompatibility(package));
+    }
+    CompatibilityChecker sharedChecker;
+    std::vector<int32_t> results(packages.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < packages.size(); ++i) {
+        threads.emplace_back(
+            [&, i] { results[i] = sharedChecker.checkCompatibility(packages[i]); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(expected, results);
+
+    // Results for the old device info must not be reused.
+    setupMockFetcher(vendorManifestXml2, systemMatrixXml2, systemManifestXml1, vendorMatrixXml1);
+    ASSERT_NE(nullptr, VintfObject::GetDeviceHalManifest(true /* skipCache */));
+    ASSERT_NE(nullptr, VintfObject::GetFrameworkCompatibilityMatrix(true /* skipCache */));
+    EXPECT_EQ(COMPATIBLE, checker.checkCompatibility({systemMatrixXml2}));
+    checker.clear();
+    EXPECT_EQ(COMPATIBLE, checker.checkCompatibility({}));
+}
+
+// Tests that packages checked against a snapshot give the same results as checking
+// them one by one, and that device files are only read once.
+TEST_F(VintfObjectCompatibleTest, TestCheckCompatibilityBatch) {
+    std::vector<std::vector<std::string>> packages{
+        {},
+        {systemMatrixXml1},
+        {systemMatrixXml2},
+        {systemMatrixXml2, vendorManifestXml2},
+        {systemMatrixXml1, systemMatrixXml2},
+        {"<manifest"},
+    };
+    std::vector<CompatibilityResult> expected;
+    for (const auto& package : packages) {
+        CompatibilityResult result;
+        result.status = VintfObject::CheckCompatibility(package, &result.error);
+        expected.push_back(result);
+    }
+
+    EXPECT_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml"), _)).Times(1);
+    EXPECT_CALL(fetcher(), fetch(StrEq("/system/manifest.xml"), _)).Times(1);
+    EXPECT_CALL(fetcher(), fetch(StrEq("/vendor/compatibility_matrix.xml"), _)).Times(1);
+    EXPECT_CALL(fetcher(), fetch(StrEq("/system/compatibility_matrix.xml"), _)).Times(1);
+    DeviceSnapshot device = VintfObject::GetDeviceSnapshot();
+    for (size_t numThreads : {1u, 3u, 0u}) {
+        std::vector<CompatibilityResult> results =
+            VintfObject::CheckCompatibility(device, packages, ENABLE_ALL_CHECKS, numThreads);
+        ASSERT_EQ(expected.size(), results.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            EXPECT_EQ(expected[i].status, results[i].status) << "package " << i;
+            EXPECT_EQ(expected[i].error, results[i].error) << "package " << i;
+        }
+    }
+    EXPECT_TRUE(VintfObject::CheckCompatibility(device, {}).empty());
+}
+
+// Tests that a snapshot is only replaced when a part changes, and that pinned
+// snapshots are unaffected.
+TEST_F(VintfObjectCompatibleTest, TestVintfSnapshot) {
+    // Without signatures, the files are read again on every refresh.
+    std::shared_ptr<const VintfSnapshot> first = VintfObject::GetVintfSnapshot(true /* refresh */);
+    ASSERT_NE(nullptr, first);
+    EXPECT_NE(nullptr, first->device().deviceManifest);
+    EXPECT_NE(nullptr, first->device().frameworkManifest);
+    EXPECT_NE(nullptr, first->device().deviceMatrix);
+    EXPECT_NE(nullptr, first->device().frameworkMatrix);
+    EXPECT_NE(nullptr, first->device().runtimeInfo);
+    EXPECT_EQ(first, VintfObject::GetVintfSnapshot());
+
+    ON_CALL(fetcher(), signature(_, _)).WillByDefault(Return(0));
+    std::shared_ptr<const VintfSnapshot> second = VintfObject::GetVintfSnapshot(true);
+    EXPECT_EQ(first->version() + 1, second->version());
+    EXPECT_NE(first->device().frameworkMatrix, second->device().frameworkMatrix);
+    EXPECT_EQ(first->device().runtimeInfo, second->device().runtimeInfo);
+
+    EXPECT_CALL(fetcher(), fetch(_, _)).Times(0);
+    EXPECT_EQ(second, VintfObject::GetVintfSnapshot(true));
+    EXPECT_EQ(second, VintfObject::GetVintfSnapshot());
+    Mock::VerifyAndClearExpectations(&fetcher());
+
+    // Replace the framework matrix on the device with an incompatible one. Snapshots
+    // published before are still checked against the objects they were built with.
+    setupMockFetcher(vendorManifestXml1, systemMatrixXml2, systemManifestXml1, vendorMatrixXml1);
+    std::shared_ptr<const VintfSnapshot> third = VintfObject::GetVintfSnapshot(true);
+    EXPECT_EQ(second->version() + 1, third->version());
+    EXPECT_EQ(INCOMPATIBLE, VintfObject::CheckCompatibility(third->device(), {{}})[0].status);
+    EXPECT_EQ(COMPATIBLE, VintfObject::CheckCompatibility(first->device(), {{}})[0].status);
+    EXPECT_EQ(COMPATIBLE, VintfObject::CheckCompatibility(second->device(), {{}})[0].status);
+}
+
+// Tests that an up-to-date binary image is read through the fetcher, and that it is not
+// used once the content of the XML file changes, even if its signature does not.
+TEST_F(VintfObjectCompatibleTest, TestBinaryImage) {
+    HalManifest manifest;
+    ASSERT_TRUE(gHalManifestConverter(&manifest, vendorManifestXml1));
+    std::string image = gHalManifestBinaryConverter.serialize(manifest, vendorManifestXml1);
+    std::string xml = vendorManifestXml1;
+    ON_CALL(fetcher(), signature(_, _))
+        .WillByDefault(Invoke([&](const std::string& path, FileSignature* sig) {
+            sig->size = path == "/vendor/manifest.xml" ? xml.size() : image.size();
+            sig->mtimeNs = 100;
+            return 0;
+        }));
+    ON_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml"), _))
+        .WillByDefault(Invoke([&xml](const std::string&, std::string& fetched) {
+            fetched = xml;
+            return 0;
+        }));
+    ON_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml.bin"), _))
+        .WillByDefault(Invoke([&image](const std::string&, std::string& fetched) {
+            fetched = image;
+            return 0;
+        }));
+
+    EXPECT_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml.bin"), _)).Times(1);
+    EXPECT_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml"), _)).Times(1);
+    std::shared_ptr<const HalManifest> fromImage = VintfObject::GetSharedDeviceHalManifest(true);
+    ASSERT_NE(nullptr, fromImage);
+    EXPECT_EQ(manifest, *fromImage);
+    Mock::VerifyAndClearExpectations(&fetcher());
+
+    // The XML file is edited in place, keeping its size and modification time.
+    xml.replace(xml.find("<version>3.5</version>"), strlen("<version>3.5</version>"),
+                "<version>3.6</version>");
+    ASSERT_EQ(vendorManifestXml1.size(), xml.size());
+    EXPECT_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml.bin"), _)).Times(1);
+    EXPECT_CALL(fetcher(), fetch(StrEq("/vendor/manifest.xml"), _)).Times(1);
+    std::shared_ptr<const HalManifest> fromXml = VintfObject::GetSharedDeviceHalManifest(true);
+    ASSERT_NE(nullptr, fromXml);
+    HalManifest edited;
+    ASSERT_TRUE(gHalManifestConverter(&edited, xml));
+    EXPECT_EQ(edited, *fromXml);
+    EXPECT_FALSE(manifest == *fromXml);
+}
+
+// Tests that files on the device are only read again when their signature changes.
+TEST_F(VintfObjectCompatibleTest, TestCacheValidation) {
+    std::map<std::string, FileSignature> signatures;
+    auto setupSignatures = [&signatures] {
+        ON_CALL(fetcher(), signature(_, _))
+            .WillByDefault(Invoke([&signatures](const std::string& path, FileSignature* sig) {
+                // There are no binary images.
+                if (android::base::EndsWith(path, ".bin")) {
+                    return -ENOENT;
+                }
+                *sig = signatures[path];
+                return 0;
+            }));
+    };
+    setupSignatures();
+    std::string error;
+
+    EXPECT_CALL(fetcher(), fetch(_, _)).Times(4);
+    ASSERT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({}, &error)) << error;
+    Mock::VerifyAndClearExpectations(&fetcher());
+
+    EXPECT_CALL(fetcher(), fetch(_, _)).Times(0);
+    ASSERT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({}, &error)) << error;
+    ASSERT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({systemMatrixXml1}, &error)) << error;
+    Mock::VerifyAndClearExpectations(&fetcher());
+
+    // Replace the framework matrix on the device with an incompatible one.
+    setupMockFetcher(vendorManifestXml1, systemMatrixXml2, systemManifestXml1, vendorMatrixXml1);
+    setupSignatures();
+    signatures["/system/compatibility_matrix.xml"].mtimeNs = 1;
+    EXPECT_CALL(fetcher(), fetch(StrEq("/system/compatibility_matrix.xml"), _)).Times(1);
+    EXPECT_CALL(fetcher(), fetch(StrNe("/system/compatibility_matrix.xml"), _)).Times(0);
+    ASSERT_EQ(INCOMPATIBLE, VintfObject::CheckCompatibility({}, &error));
+}
+
+// Tests that the first problem in the package is reported, although XMLs are parsed in parallel.
+TEST_F(VintfObjectCompatibleTest, TestPackageErrorOrder) {
+    std::string error;
+    std::vector<std::string> packageInfo = {vendorManifestXml1, systemMatrixXml1,
+                                            systemMatrixXml2, vendorManifestXml2, "<manifest"};
+    EXPECT_EQ(android::ALREADY_EXISTS, VintfObject::CheckCompatibility(packageInfo, &error));
+    EXPECT_EQ("duplicated framework matrix", error);
+
+    error.clear();
+    packageInfo = {systemMatrixXml1, "<manifest", vendorManifestXml1, vendorManifestXml2};
+    EXPECT_EQ(android::BAD_VALUE, VintfObject::CheckCompatibility(packageInfo, &error));
+    EXPECT_EQ("parse error", error);
+}
+
+// Tests that package XMLs are parsed once, and that the cache is bounded.
+TEST_F(VintfObjectCompatibleTest, TestParsedXmlCache) {
+    ParsedXmlCache& cache = VintfObject::GetParsedXmlCache();
+    cache.clear();
+    cache.setCapacity(2);
+    std::string error;
+
+    EXPECT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({systemMatrixXml1}, &error)) << error;
+    EXPECT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({systemMatrixXml1}, &error)) << error;
+    EXPECT_EQ(INCOMPATIBLE, VintfObject::CheckCompatibility({systemMatrixXml2}, &error));
+    EXPECT_EQ(
+        "Device manifest and framework compatibility matrix are incompatible: HALs "
+        "incompatible. android.hardware.foo",
+        error);
+    EXPECT_EQ(android::BAD_VALUE, VintfObject::CheckCompatibility({"<manifest"}, &error));
+    ParsedXmlCache::Stats stats = cache.stats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(3u, stats.misses);
+    EXPECT_EQ(2u, stats.size);
+    EXPECT_EQ(0u, stats.evictions);
+
+    // systemMatrixXml1 was used least recently.
+    error.clear();
+    EXPECT_EQ(COMPATIBLE,
+              VintfObject::CheckCompatibility({systemMatrixXml2, vendorManifestXml2}, &error))
+        << error;
+    stats = cache.stats();
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(4u, stats.misses);
+    EXPECT_EQ(2u, stats.size);
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({systemMatrixXml1}, &error)) << error;
+    EXPECT_EQ(5u, cache.stats().misses);
+
+    cache.setCapacity(0);
+    EXPECT_EQ(0u, cache.stats().size);
+    EXPECT_EQ(COMPATIBLE, VintfObject::CheckCompatibility({systemMatrixXml1}, &error)) << error;
+    EXPECT_EQ(0u, cache.stats().size);
+    EXPECT_EQ(6u, cache.stats().misses);
+
+    cache.setCapacity(ParsedXmlCache::kDefaultCapacity);
+    cache.clear();
+}
+
 // Test fixture that provides incompatible metadata from the mock device.
 class VintfObjectIncompatibleTest : public testing::Test {
    protected:
@@ -439,6 +766,62 @@ TEST_F(VintfObjectIncompatibleTest, TestInputVsDeviceSuccess) {
     ASSERT_STREQ(error.c_str(), "");
 }
 
+// The real FileFetcher reads the whole file, whatever its size.
+TEST(FileFetcherTest, Fetch) {
+    FileFetcher real;
+    std::string fetched = "stale";
+    for (size_t size : {0u, 1u, 4096u, 100000u}) {
+        TemporaryFile file;
+        std::string content(size, 'x');
+        for (size_t i = 0; i < size; ++i) {
+            content[i] = 'a' + i % 26;
+        }
+        ASSERT_EQ(static_cast<ssize_t>(size), write(file.fd, content.data(), size));
+        ASSERT_EQ(android::OK, real.fetch(file.path, fetched));
+        EXPECT_EQ(content, fetched) << "size " << size;
+    }
+    EXPECT_EQ(android::INVALID_OPERATION, real.fetch("/nonexistent/manifest.xml", fetched));
+}
+
+// Slow fetch steps run on their own threads only when there is something to overlap them with.
+TEST(FetchStepsTest, RunInParallel) {
+    std::thread::id caller = std::this_thread::get_id();
+    std::vector<std::thread::id> threads;
+    auto makeSteps = [&threads](std::vector<bool> slow) {
+        threads.assign(slow.size(), std::thread::id());
+        std::vector<FetchStep> steps;
+        for (size_t i = 0; i < slow.size(); ++i) {
+            steps.push_back({[&threads, i] {
+                                 threads[i] = std::this_thread::get_id();
+                                 return static_cast<android::status_t>(i);
+                             },
+                             slow[i]});
+        }
+        return steps;
+    };
+
+    EXPECT_EQ((std::vector<android::status_t>{0, 1, 2, 3}),
+              runFetchSteps(makeSteps({false, true, false, true}), true /* parallel */));
+    EXPECT_EQ(caller, threads[0]);
+    EXPECT_NE(caller, threads[1]);
+    EXPECT_EQ(caller, threads[2]);
+    EXPECT_NE(caller, threads[3]);
+    EXPECT_NE(threads[1], threads[3]);
+
+    EXPECT_EQ((std::vector<android::status_t>{0, 1}),
+              runFetchSteps(makeSteps({true, true}), true /* parallel */));
+    EXPECT_EQ(caller, threads[0]) << "One slow step should run on the calling thread";
+    EXPECT_NE(caller, threads[1]);
+
+    runFetchSteps(makeSteps({true}), true /* parallel */);
+    EXPECT_EQ(caller, threads[0]) << "A single step should not start a thread";
+
+    runFetchSteps(makeSteps({false, true, true}), false /* parallel */);
+    for (std::thread::id thread : threads) {
+        EXPECT_EQ(caller, thread) << "Steps should run on the calling thread if not parallel";
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleMock(&argc, argv);
 
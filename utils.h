@@ -18,37 +18,118 @@
 #define ANDROID_VINTF_UTILS_H
 
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
 #include <sstream>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <android-base/logging.h>
 #include <utils/Errors.h>
 
+#include "parse_binary.h"
 #include "parse_xml.h"
 
 namespace android {
 namespace vintf {
 namespace details {
 
+// A string with a separate value in each thread. The converters are global objects
+// shared by all threads, so their last errors are stored in these.
+class PerThreadString {
+   public:
+    inline PerThreadString& operator=(std::string s) {
+        get() = std::move(s);
+        return *this;
+    }
+    inline operator const std::string&() const { return get(); }
+
+   private:
+    inline std::string& get() const {
+        thread_local std::map<const PerThreadString*, std::string> values;
+        return values[this];
+    }
+};
+
+// Identifies a version of a file, so that a cached object read from the file can be
+// reused as long as the file has not changed.
+struct FileSignature {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    int64_t ctimeNs = 0;
+
+    inline bool operator==(const FileSignature& other) const {
+        return device == other.device && inode == other.inode && size == other.size &&
+               mtimeNs == other.mtimeNs && ctimeNs == other.ctimeNs;
+    }
+    inline bool operator!=(const FileSignature& other) const { return !(*this == other); }
+};
+
 // Return the file from the given location as a string.
 //
 // This class can be used to create a mock for overriding.
 class FileFetcher {
    public:
     virtual ~FileFetcher() {}
+    // Return the current signature of the file at path. If this fails, the file
+    // is always considered changed.
+    virtual status_t signature(const std::string& path, FileSignature* sig) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return -errno;
+        }
+        sig->device = st.st_dev;
+        sig->inode = st.st_ino;
+        sig->size = st.st_size;
+#ifdef __APPLE__
+        sig->mtimeNs = st.st_mtimespec.tv_sec * 1000000000ll + st.st_mtimespec.tv_nsec;
+        sig->ctimeNs = st.st_ctimespec.tv_sec * 1000000000ll + st.st_ctimespec.tv_nsec;
+#else
+        sig->mtimeNs = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+        sig->ctimeNs = st.st_ctim.tv_sec * 1000000000ll + st.st_ctim.tv_nsec;
+#endif
+        return OK;
+    }
     virtual status_t fetch(const std::string& path, std::string& fetched) {
-        std::ifstream in;
-
-        in.open(path);
-        if (!in.is_open()) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
             LOG(WARNING) << "Cannot open " << path;
             return INVALID_OPERATION;
         }
-
-        std::stringstream ss;
-        ss << in.rdbuf();
-        fetched = ss.str();
-
+        // Read directly into a buffer of the file size, with one byte to spare so
+        // that the read that sees the end of the file does not grow it. Files that
+        // do not report a size, like those in /proc, grow the buffer as they are read.
+        struct stat st;
+        size_t capacity = fstat(fd, &st) == 0 && st.st_size > 0 ? st.st_size + 1 : 4096;
+        fetched.resize(capacity);
+        size_t size = 0;
+        for (;;) {
+            if (size == fetched.size()) {
+                fetched.resize(fetched.size() * 2);
+            }
+            ssize_t n = TEMP_FAILURE_RETRY(read(fd, &fetched[size], fetched.size() - size));
+            if (n < 0) {
+                LOG(WARNING) << "Cannot read " << path << ": " << strerror(errno);
+                close(fd);
+                fetched.clear();
+                return INVALID_OPERATION;
+            }
+            if (n == 0) {
+                break;
+            }
+            size += n;
+        }
+        close(fd);
+        fetched.resize(size);
         return OK;
     }
 };
@@ -66,9 +147,51 @@ class PartitionMounter {
 
 extern PartitionMounter* gPartitionMounter;
 
+// One independent part of a fetch. Slow steps are worth a thread of their own.
+struct FetchStep {
+    std::function<status_t()> fetch;
+    bool slow;
+};
+
+// Run the steps and return their results in order. If parallel, slow steps run on
+// their own threads while the other steps run on this thread. If there is no other
+// step, one slow step runs on this thread, so a single step never starts a thread.
+inline std::vector<status_t> runFetchSteps(const std::vector<FetchStep>& steps, bool parallel) {
+    bool hasFastStep = std::any_of(steps.begin(), steps.end(),
+                                   [](const FetchStep& step) { return !step.slow; });
+    bool keepSlowStep = !hasFastStep;
+    std::vector<std::future<status_t>> futures(steps.size());
+    for (size_t i = 0; parallel && i < steps.size(); ++i) {
+        if (!steps[i].slow) {
+            continue;
+        }
+        if (keepSlowStep) {
+            keepSlowStep = false;
+            continue;
+        }
+        futures[i] = std::async(std::launch::async, steps[i].fetch);
+    }
+    std::vector<status_t> results(steps.size());
+    for (size_t i = 0; i < steps.size(); ++i) {
+        if (!futures[i].valid()) {
+            results[i] = steps[i].fetch();
+        }
+    }
+    for (size_t i = 0; i < steps.size(); ++i) {
+        if (futures[i].valid()) {
+            results[i] = futures[i].get();
+        }
+    }
+    return results;
+}
+
+// Read the XML file at path into outObject. If an up-to-date binary image of
+// the file exists at binaryImagePath(path), decode it instead of parsing the XML.
+// The XML file is still read, so that a stale image is never used. Both files
+// are read through gFetcher.
 template <typename T>
 status_t fetchAllInformation(const std::string& path, const XmlConverter<T>& converter,
-                             T* outObject) {
+                             const BinaryConverter<T>& binaryConverter, T* outObject) {
     std::string info;
 
     if (gFetcher == nullptr) {
@@ -82,6 +205,18 @@ status_t fetchAllInformation(const std::string& path, const XmlConverter<T>& con
         return result;
     }
 
+    // A missing image is common, so only fetch it if it exists.
+    std::string imagePath = binaryImagePath(path);
+    FileSignature imageSignature;
+    std::string image;
+    if (gFetcher->signature(imagePath, &imageSignature) == OK &&
+        gFetcher->fetch(imagePath, image) == OK) {
+        if (binaryConverter.deserialize(outObject, image.data(), image.size(), info)) {
+            return OK;
+        }
+        LOG(DEBUG) << "Not using " << imagePath << ": " << binaryConverter.lastError();
+    }
+
     bool success = converter(outObject, info);
     if (!success) {
         LOG(ERROR) << "Illformed file: " << path << ": "